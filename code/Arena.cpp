@@ -0,0 +1,188 @@
+#include "Arena.h"
+#include <new>
+#include <mutex>
+#include <atomic>
+#include <cstdlib>
+#include <exception>
+#include <sys/mman.h>
+
+using namespace std;
+
+//Address space only, the pages get committed as the arenas grow
+static const size_t SLICE = (size_t)8 << 30;
+static const size_t SLICES = 16;
+static const size_t COMMIT = (size_t)4 << 20;
+
+//Memory past this much stays committed after a rewind, the rest goes back
+static const size_t KEEP = (size_t)64 << 20;
+
+static char* regionStart = nullptr;
+static char* regionEnd = nullptr;
+static atomic<size_t> slicesTaken(0);
+
+static thread_local Arena* active = nullptr;
+
+Arena::Arena(char* start, char* end) : start(start), end(end), next(start), committed(start)
+{
+}
+
+Arena* Arena::forThisThread()
+{
+    static once_flag reserved;
+    call_once(reserved, [] {
+        void* region = mmap(nullptr, SLICE * SLICES, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (region != MAP_FAILED)
+        {
+            regionStart = static_cast<char*>(region);
+            regionEnd = regionStart + SLICE * SLICES;
+        }
+    });
+
+    static thread_local Arena* mine = nullptr;
+    if (mine == nullptr && regionStart != nullptr)
+    {
+        size_t slice = slicesTaken++;
+        if (slice < SLICES)
+        {
+            //Made outside any arena, it lives as long as the thread
+            ArenaPause pause;
+            char* start = regionStart + slice * SLICE;
+            mine = new Arena(start, start + SLICE);
+        }
+    }
+
+    return mine;
+}
+
+void* Arena::allocate(size_t size)
+{
+    size = (size + 15) & ~(size_t)15;
+    if (size > (size_t)(end - next))
+    {
+        return nullptr;
+    }
+
+    if (next + size > committed)
+    {
+        size_t needed = next + size - committed;
+        size_t grow = min((size_t)(end - committed), (needed + COMMIT - 1) / COMMIT * COMMIT);
+        if (mprotect(committed, grow, PROT_READ | PROT_WRITE) != 0)
+        {
+            return nullptr;
+        }
+        committed += grow;
+    }
+
+    void* pointer = next;
+    next += size;
+    return pointer;
+}
+
+void Arena::rewind(char* position)
+{
+    next = position;
+
+    char* kept = next + KEEP;
+    if (kept < committed)
+    {
+        madvise(kept, committed - kept, MADV_DONTNEED);
+    }
+}
+
+bool Arena::owns(const void* pointer)
+{
+    return pointer >= regionStart && pointer < regionEnd;
+}
+
+ArenaScope::ArenaScope(Arena* arena)
+    : previous(active), arena(arena), mark(arena != nullptr ? arena->next : nullptr), exceptions(uncaught_exceptions())
+{
+    active = arena;
+}
+
+//Scopes nest on a thread, so rewinding to the mark only frees what this one
+//allocated. An exception on its way out may hold arena memory (its message),
+//so then the memory is left alone
+ArenaScope::~ArenaScope()
+{
+    active = previous;
+    if (arena != nullptr && uncaught_exceptions() == exceptions)
+    {
+        arena->rewind(mark);
+    }
+}
+
+void* operator new(size_t size)
+{
+    if (active != nullptr)
+    {
+        void* pointer = active->allocate(size);
+        if (pointer != nullptr)
+        {
+            return pointer;
+        }
+    }
+
+    void* pointer = malloc(size == 0 ? 1 : size);
+    if (pointer == nullptr)
+    {
+        throw bad_alloc();
+    }
+
+    return pointer;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(size_t size, const nothrow_t&) noexcept
+{
+    try
+    {
+        return operator new(size);
+    }
+    catch (const bad_alloc&)
+    {
+        return nullptr;
+    }
+}
+
+void* operator new[](size_t size, const nothrow_t&) noexcept
+{
+    return operator new(size, nothrow);
+}
+
+void operator delete(void* pointer) noexcept
+{
+    if (!Arena::owns(pointer))
+    {
+        free(pointer);
+    }
+}
+
+void operator delete[](void* pointer) noexcept
+{
+    operator delete(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept
+{
+    operator delete(pointer);
+}
+
+void operator delete[](void* pointer, size_t) noexcept
+{
+    operator delete(pointer);
+}
+
+void operator delete(void* pointer, const nothrow_t&) noexcept
+{
+    operator delete(pointer);
+}
+
+void operator delete[](void* pointer, const nothrow_t&) noexcept
+{
+    operator delete(pointer);
+}
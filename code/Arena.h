@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+
+using namespace std;
+
+//Bump allocation for the short lived intermediate relations of a rule. While
+//an ArenaScope is alive, operator new on its thread hands out the next bytes
+//of the thread's arena and delete of them does nothing. When the scope ends
+//the arena goes back to where it was, freeing everything allocated in it at
+//once. Anything that has to outlive the scope must be allocated under an
+//ArenaPause.
+//
+//Every thread's arena is a slice of one reserved address range, so telling
+//arena memory from malloc memory in delete is two comparisons
+class Arena
+{
+private:
+    char* start;
+    char* end;
+    char* next;
+    char* committed;
+
+    Arena(char* start, char* end);
+
+    friend class ArenaScope;
+
+public:
+    //This thread's arena, or nullptr if they've all been handed out
+    static Arena* forThisThread();
+
+    //nullptr if the arena is full
+    void* allocate(size_t size);
+
+    //Back to an earlier position, giving most of the memory past it back
+    void rewind(char* position);
+
+    static bool owns(const void* pointer);
+};
+
+class ArenaScope
+{
+private:
+    Arena* previous;
+    Arena* arena;
+    char* mark;
+    int exceptions;
+
+public:
+    ArenaScope(Arena* arena);
+    ~ArenaScope();
+
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+};
+
+//Allocations go to malloc again until it ends
+class ArenaPause : public ArenaScope
+{
+public:
+    ArenaPause() : ArenaScope(nullptr) {}
+};
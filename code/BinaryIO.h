@@ -0,0 +1,114 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <istream>
+#include <ostream>
+#include <cstdint>
+#include "Relation.h"
+#include "Tuple.h"
+
+using namespace std;
+
+//Helpers for the files the interpreter writes for itself (checkpoints, cached
+//results). Numbers are stored in the machine's byte order, strings with their
+//length in front. The readers return false on a short read
+
+inline void putNumber(ostream& out, uint32_t value)
+{
+    out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+inline void putString(ostream& out, const string& value)
+{
+    putNumber(out, value.size());
+    out.write(value.data(), value.size());
+}
+
+inline bool getNumber(istream& in, uint32_t& value)
+{
+    return (bool)in.read(reinterpret_cast<char*>(&value), sizeof(value));
+}
+
+inline bool getString(istream& in, string& value)
+{
+    uint32_t size;
+    if (!getNumber(in, size))
+    {
+        return false;
+    }
+
+    value.resize(size);
+    return (bool)in.read(&value[0], size);
+}
+
+//A relation's name, arity, tuple count and then its values row by row
+inline void putTuples(ostream& out, const Relation& relation)
+{
+    putString(out, relation.getName());
+    putNumber(out, relation.getSchemeNames().size());
+    putNumber(out, relation.size());
+
+    for (const Tuple& tuple : relation)
+    {
+        for (const string& value : tuple)
+        {
+            putString(out, value);
+        }
+    }
+}
+
+inline bool getTuples(istream& in, string& name, vector<Tuple>& tuples)
+{
+    uint32_t arity;
+    uint32_t count;
+    if (!getString(in, name) || !getNumber(in, arity) || !getNumber(in, count))
+    {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        vector<string> values(arity);
+        for (uint32_t j = 0; j < arity; j++)
+        {
+            if (!getString(in, values.at(j)))
+            {
+                return false;
+            }
+        }
+
+        tuples.push_back(Tuple(values));
+    }
+
+    return true;
+}
+
+//128 bit FNV-1a, for keys where a collision would mean a wrong answer. Not
+//cryptographic, but nothing picks the inputs to collide on purpose
+typedef unsigned __int128 Hash128;
+
+inline Hash128 hashText128(const string& text, Hash128 seed = ((Hash128)0x6c62272e07bb0142ULL << 64) | 0x62b821756295c58dULL)
+{
+    const Hash128 prime = ((Hash128)1 << 88) | 0x13b;
+    for (char c : text)
+    {
+        seed ^= (unsigned char)c;
+        seed *= prime;
+    }
+
+    return seed;
+}
+
+//FNV-1a, stable between runs unlike hash<string>. Passing the last result
+//back in as the seed hashes several strings as one
+inline unsigned long long hashText(const string& text, unsigned long long seed = 14695981039346656037ULL)
+{
+    for (char c : text)
+    {
+        seed ^= (unsigned char)c;
+        seed *= 1099511628211ULL;
+    }
+
+    return seed;
+}
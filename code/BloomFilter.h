@@ -0,0 +1,90 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+using namespace std;
+
+//A blocked Bloom filter. Each key sets one bit in every word of a single
+//64 byte block, so a lookup touches one cache line. It can say a key is
+//definitely not there, never that it is
+class BloomFilter
+{
+private:
+    static const unsigned WORDS = 8;
+    static const unsigned BITS_PER_KEY = 12;
+
+    vector<uint64_t> words;
+    size_t capacity;
+    size_t keys;
+
+    size_t block(size_t hash) const
+    {
+        //The high half of the hash picks the block, the low half the bits
+        return ((hash >> 32) & (words.size() / WORDS - 1)) * WORDS;
+    }
+
+    //Another hash from the first, so every word gets a different bit
+    static uint64_t bits(size_t hash)
+    {
+        return (uint64_t)hash * 0x9e3779b97f4a7c15ULL;
+    }
+
+public:
+    BloomFilter() : capacity(0), keys(0) {}
+
+    //Sized for the given number of keys, rounded up to a power of two blocks
+    explicit BloomFilter(size_t capacity) : capacity(capacity), keys(0)
+    {
+        size_t blocks = 1;
+        while (blocks * WORDS * 64 < capacity * BITS_PER_KEY)
+        {
+            blocks *= 2;
+        }
+
+        words.assign(blocks * WORDS, 0);
+    }
+
+    bool empty() const
+    {
+        return words.empty();
+    }
+
+    size_t bytes() const
+    {
+        return words.capacity() * sizeof(uint64_t);
+    }
+
+    //Past its capacity the false positives climb, time to build a bigger one
+    bool full() const
+    {
+        return keys >= capacity;
+    }
+
+    void insert(size_t hash)
+    {
+        uint64_t spread = bits(hash);
+        uint64_t* line = &words[block(hash)];
+        for (unsigned i = 0; i < WORDS; i++)
+        {
+            line[i] |= 1ULL << ((spread >> (i * 6)) & 63);
+        }
+        keys++;
+    }
+
+    bool mayContain(size_t hash) const
+    {
+        uint64_t spread = bits(hash);
+        const uint64_t* line = &words[block(hash)];
+        for (unsigned i = 0; i < WORDS; i++)
+        {
+            if ((line[i] & (1ULL << ((spread >> (i * 6)) & 63))) == 0)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+};
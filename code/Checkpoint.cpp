@@ -0,0 +1,158 @@
+#include "Checkpoint.h"
+#include "BinaryIO.h"
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstring>
+#include <stdexcept>
+#include <unistd.h>
+
+using namespace std;
+
+static const char MAGIC[8] = { 'D', 'L', 'C', 'K', 'P', 'T', '1', '\0' };
+
+Checkpoint::Checkpoint(const string& path, unsigned long long key, double interval, const Progress& resumed)
+    : interval(interval), lastWrite(chrono::steady_clock::now())
+{
+    bool append = resumed.length > 0;
+    if (append && truncate(path.c_str(), resumed.length) != 0)
+    {
+        throw runtime_error("Couldn't write " + path);
+    }
+
+    out.open(path, ios::binary | (append ? ios::app : ios::trunc));
+    if (!out.is_open())
+    {
+        throw runtime_error("Couldn't write " + path);
+    }
+
+    if (!append)
+    {
+        out.write(MAGIC, sizeof(MAGIC));
+        out.write(reinterpret_cast<const char*>(&key), sizeof(key));
+        out.flush();
+    }
+}
+
+void Checkpoint::addTuples(const Relation& added)
+{
+    auto it = pending.find(added.getName());
+    if (it == pending.end())
+    {
+        pending.emplace(added.getName(), added);
+        return;
+    }
+
+    for (const Tuple& tuple : added)
+    {
+        it->second.addTuple(tuple);
+    }
+}
+
+void Checkpoint::addTrace(const string& trace)
+{
+    pendingTrace += trace;
+}
+
+void Checkpoint::passDone(int scc, int passes)
+{
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - lastWrite;
+    if (elapsed.count() >= interval)
+    {
+        write(scc, passes, false);
+    }
+}
+
+void Checkpoint::sccDone(int scc, int passes)
+{
+    write(scc, passes, true);
+}
+
+//'T' records carry tuples, the 'C' record after them commits them
+void Checkpoint::write(int scc, int passes, bool done)
+{
+    for (auto& pair : pending)
+    {
+        out.put('T');
+        putTuples(out, pair.second);
+    }
+
+    out.put('C');
+    putNumber(out, scc);
+    putNumber(out, passes);
+    out.put(done ? 1 : 0);
+    putString(out, pendingTrace);
+    out.flush();
+
+    pending.clear();
+    pendingTrace.clear();
+    lastWrite = chrono::steady_clock::now();
+}
+
+bool Checkpoint::load(const string& path, unsigned long long key, Database& database, Progress& progress)
+{
+    ifstream in(path, ios::binary);
+    if (!in.is_open())
+    {
+        return false;
+    }
+
+    char magic[sizeof(MAGIC)];
+    unsigned long long fileKey;
+    if (!in.read(magic, sizeof(magic)) || memcmp(magic, MAGIC, sizeof(MAGIC)) != 0
+        || !in.read(reinterpret_cast<char*>(&fileKey), sizeof(fileKey)) || fileKey != key)
+    {
+        return false;
+    }
+
+    //Tuples wait here until the record that commits them shows up
+    vector<pair<string, Tuple>> uncommitted;
+
+    char type;
+    while (in.get(type))
+    {
+        if (type == 'T')
+        {
+            string name;
+            vector<Tuple> tuples;
+            if (!getTuples(in, name, tuples))
+            {
+                break;
+            }
+
+            for (Tuple& tuple : tuples)
+            {
+                uncommitted.push_back(make_pair(name, tuple));
+            }
+        }
+        else if (type == 'C')
+        {
+            uint32_t scc;
+            uint32_t passes;
+            char done;
+            string trace;
+            if (!getNumber(in, scc) || !getNumber(in, passes) || !in.get(done) || !getString(in, trace))
+            {
+                break;
+            }
+
+            for (auto& pair : uncommitted)
+            {
+                database.getRelation(pair.first).addTuple(pair.second);
+            }
+            uncommitted.clear();
+
+            progress.lastScc = scc;
+            progress.lastPasses = passes;
+            progress.lastDone = done != 0;
+            progress.traces[scc] += trace;
+            progress.length = in.tellg();
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    return true;
+}
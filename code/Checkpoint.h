@@ -0,0 +1,63 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <fstream>
+#include <chrono>
+#include "Database.h"
+#include "Relation.h"
+#include "Tuple.h"
+
+using namespace std;
+
+//How far a checkpointed run got. SCCs before lastScc are done, lastScc is done
+//if lastDone is set and otherwise has finished lastPasses passes
+struct Progress
+{
+    Progress() : lastScc(-1), lastPasses(0), lastDone(true), length(0) {}
+
+    int lastScc;
+    int lastPasses;
+    bool lastDone;
+
+    //Where the last complete record ends, anything after it is cut off
+    long length;
+
+    //What each SCC printed so far, replayed on resume
+    map<int, string> traces;
+};
+
+//An append only log of a rule evaluation. Every record holds only the tuples
+//added since the one before it, plus the trace printed in the meantime, so
+//writing one costs about as much as the work since the last. A record is
+//only used on resume once it has been written out completely
+class Checkpoint
+{
+private:
+    ofstream out;
+    double interval;
+    chrono::steady_clock::time_point lastWrite;
+
+    Database pending;
+    string pendingTrace;
+
+    void write(int scc, int passes, bool done);
+
+public:
+    //The key ties the log to one program, a log for another one is ignored.
+    //Resuming, the log is kept up to the given length and added to
+    Checkpoint(const string& path, unsigned long long key, double interval, const Progress& resumed);
+
+    //Reads the log back, putting its tuples in the database. Returns false if
+    //there's no usable log for this program
+    static bool load(const string& path, unsigned long long key, Database& database, Progress& progress);
+
+    //Tuples a pass added, kept until the next record
+    void addTuples(const Relation& added);
+    void addTrace(const string& trace);
+
+    //A pass boundary only gets written once the interval has passed since
+    //the last record, the end of an SCC always does
+    void passDone(int scc, int passes);
+    void sccDone(int scc, int passes);
+};
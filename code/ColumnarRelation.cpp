@@ -0,0 +1,253 @@
+#include "ColumnarRelation.h"
+#include "Query.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <algorithm>
+#include <unordered_set>
+
+using namespace std;
+
+//Hashes a key of ids, for the join filter
+struct IdsHash
+{
+    size_t operator()(const vector<uint32_t>& ids) const
+    {
+        size_t seed = ids.size();
+        for (uint32_t id : ids)
+        {
+            seed ^= id + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+        }
+
+        return seed;
+    }
+};
+
+ColumnarRelation::ColumnarRelation(const Relation& relation)
+    : name(relation.getName()), scheme(relation.getSchemeNames()), rows(relation.size())
+{
+    set<string> values;
+    for (const Tuple& tuple : relation)
+    {
+        values.insert(tuple.begin(), tuple.end());
+    }
+    dictionary.assign(values.begin(), values.end());
+
+    if (scheme.empty())
+    {
+        return;
+    }
+
+    //The widest gap between neighbouring first column ids sets the delta width
+    uint32_t maxDelta = 0;
+    long previous = 0;
+    for (const Tuple& tuple : relation)
+    {
+        long id = find(tuple[0]);
+        maxDelta = max(maxDelta, (uint32_t)(id - previous));
+        previous = id;
+    }
+
+    unsigned idWidth = PackedInts::widthFor(dictionary.empty() ? 0 : dictionary.size() - 1);
+    leading = PackedInts(PackedInts::widthFor(maxDelta));
+    columns.assign(scheme.size() - 1, PackedInts(idWidth));
+
+    size_t row = 0;
+    previous = 0;
+    for (const Tuple& tuple : relation)
+    {
+        long id = find(tuple[0]);
+        if (row % BLOCK == 0)
+        {
+            blockStarts.push_back(id);
+        }
+        leading.push_back(id - previous);
+        previous = id;
+
+        for (unsigned i = 1; i < tuple.size(); i++)
+        {
+            columns[i - 1].push_back(find(tuple[i]));
+        }
+        row++;
+    }
+}
+
+long ColumnarRelation::find(const string& value) const
+{
+    auto it = lower_bound(dictionary.begin(), dictionary.end(), value);
+    if (it == dictionary.end() || *it != value)
+    {
+        return -1;
+    }
+
+    return it - dictionary.begin();
+}
+
+Tuple ColumnarRelation::decode(const vector<uint32_t>& ids) const
+{
+    vector<string> values;
+    values.reserve(ids.size());
+    for (uint32_t id : ids)
+    {
+        values.push_back(dictionary[id]);
+    }
+
+    return Tuple(move(values));
+}
+
+Relation ColumnarRelation::select(const Predicate& predicate, const Relation* joinWith) const
+{
+    Relation result(name, scheme);
+    if (scheme.empty())
+    {
+        return result;
+    }
+
+    Query query(predicate.getParams());
+
+    //Constants become ids, one that isn't in the dictionary matches nothing
+    vector<pair<int, uint32_t>> constants;
+    for (int index : query.getConstants())
+    {
+        long id = find(query.at(index).value);
+        if (id < 0)
+        {
+            return result;
+        }
+        constants.push_back(make_pair(index, id));
+    }
+
+    //Repeated variables, and the columns shared with the other side of the join
+    vector<vector<int>> repeated;
+    vector<int> probeColumns;
+    vector<int> joinColumns;
+    vector<string> joinNames = joinWith != nullptr ? joinWith->getSchemeNames() : vector<string>();
+    for (auto& variable : query.getVariables())
+    {
+        if (variable.second.size() > 1)
+        {
+            repeated.push_back(variable.second);
+        }
+
+        auto it = std::find(joinNames.begin(), joinNames.end(), variable.first);
+        if (it != joinNames.end())
+        {
+            probeColumns.push_back(variable.second.at(0));
+            joinColumns.push_back(it - joinNames.begin());
+        }
+    }
+
+    unordered_set<vector<uint32_t>, IdsHash> keys;
+    if (!probeColumns.empty())
+    {
+        for (const Tuple& tuple : *joinWith)
+        {
+            vector<uint32_t> key;
+            for (int column : joinColumns)
+            {
+                long id = find(tuple[column]);
+                if (id < 0)
+                {
+                    break;
+                }
+                key.push_back(id);
+            }
+
+            if (key.size() == joinColumns.size())
+            {
+                keys.insert(key);
+            }
+        }
+
+        if (keys.empty())
+        {
+            return result;
+        }
+    }
+
+    //A constant in the first column narrows the scan to the blocks around it
+    size_t begin = 0;
+    long stopAfter = -1;
+    for (auto& constant : constants)
+    {
+        if (constant.first == 0)
+        {
+            size_t block = lower_bound(blockStarts.begin(), blockStarts.end(), constant.second) - blockStarts.begin();
+            begin = (block == 0 ? 0 : block - 1) * BLOCK;
+            stopAfter = constant.second;
+        }
+    }
+
+    uint32_t first = begin < rows ? blockStarts[begin / BLOCK] - leading.get(begin) : 0;
+    vector<uint32_t> ids(scheme.size());
+    vector<uint32_t> key(probeColumns.size());
+    for (size_t row = begin; row < rows; row++)
+    {
+        first += leading.get(row);
+        if (stopAfter >= 0 && first > stopAfter)
+        {
+            break;
+        }
+
+        ids[0] = first;
+        for (unsigned i = 1; i < ids.size(); i++)
+        {
+            ids[i] = columns[i - 1].get(row);
+        }
+
+        bool matches = true;
+        for (auto& constant : constants)
+        {
+            matches = matches && ids[constant.first] == constant.second;
+        }
+        for (auto& positions : repeated)
+        {
+            for (int position : positions)
+            {
+                matches = matches && ids[position] == ids[positions.at(0)];
+            }
+        }
+        if (matches && !probeColumns.empty())
+        {
+            for (unsigned i = 0; i < probeColumns.size(); i++)
+            {
+                key[i] = ids[probeColumns[i]];
+            }
+            matches = keys.count(key) > 0;
+        }
+
+        //Rows come out in order, so each one goes on the end
+        if (matches)
+        {
+            result.tuples.emplace_hint(result.tuples.end(), decode(ids));
+        }
+    }
+
+    return result;
+}
+
+Relation ColumnarRelation::decode() const
+{
+    return select(Predicate(name));
+}
+
+size_t ColumnarRelation::size() const
+{
+    return rows;
+}
+
+size_t ColumnarRelation::bytes() const
+{
+    size_t total = sizeof(*this) + leading.bytes() + blockStarts.capacity() * sizeof(uint32_t);
+    for (const string& value : dictionary)
+    {
+        total += sizeof(string) + (value.capacity() > 15 ? value.capacity() + 1 : 0);
+    }
+    for (const PackedInts& column : columns)
+    {
+        total += sizeof(PackedInts) + column.bytes();
+    }
+
+    return total;
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "Relation.h"
+#include "Predicate.h"
+#include "Scheme.h"
+#include "FrozenRelation.h"
+
+using namespace std;
+
+//Unsigned integers packed at a fixed number of bits each
+class PackedInts
+{
+private:
+    vector<uint64_t> words;
+    unsigned width;
+    size_t count;
+
+public:
+    PackedInts(unsigned width = 0) : width(width), count(0) {}
+
+    void push_back(uint32_t value)
+    {
+        size_t bit = count * width;
+        if ((bit + width + 63) / 64 > words.size())
+        {
+            words.push_back(0);
+        }
+
+        if (width > 0)
+        {
+            words[bit / 64] |= (uint64_t)value << (bit % 64);
+            if (bit % 64 + width > 64)
+            {
+                words[bit / 64 + 1] |= (uint64_t)value >> (64 - bit % 64);
+            }
+        }
+        count++;
+    }
+
+    uint32_t get(size_t i) const
+    {
+        if (width == 0)
+        {
+            return 0;
+        }
+
+        size_t bit = i * width;
+        uint64_t value = words[bit / 64] >> (bit % 64);
+        if (bit % 64 + width > 64)
+        {
+            value |= words[bit / 64 + 1] << (64 - bit % 64);
+        }
+
+        return value & ((1ULL << width) - 1);
+    }
+
+    size_t bytes() const
+    {
+        return words.capacity() * sizeof(uint64_t);
+    }
+
+    //Bits needed to hold values up to max
+    static unsigned widthFor(uint32_t max)
+    {
+        unsigned width = 0;
+        while (width < 32 && (max >> width) != 0)
+        {
+            width++;
+        }
+
+        return width;
+    }
+};
+
+//A read only copy of a relation stored column by column. Every value becomes
+//an id into one sorted dictionary, so ids compare the way the strings do and
+//the same value has the same id in every column. The first column is sorted,
+//it's kept as bit packed deltas with the full id every BLOCK rows to seek by.
+//The other columns are bit packed ids
+class ColumnarRelation : public FrozenRelation
+{
+private:
+    static const unsigned BLOCK = 64;
+
+    string name;
+    Scheme scheme;
+    vector<string> dictionary;
+    size_t rows;
+
+    PackedInts leading;
+    vector<uint32_t> blockStarts;
+    vector<PackedInts> columns;
+
+    //The id of a value, or -1 if it's not in the relation
+    long find(const string& value) const;
+
+    Tuple decode(const vector<uint32_t>& ids) const;
+
+public:
+    ColumnarRelation(const Relation& relation);
+
+    //Rows without a match in joinWith are dropped before decoding
+    Relation select(const Predicate& predicate, const Relation* joinWith = nullptr) const override;
+
+    Relation decode() const override;
+
+    size_t size() const override;
+    size_t bytes() const override;
+};
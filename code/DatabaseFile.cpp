@@ -0,0 +1,435 @@
+#include "DatabaseFile.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+static const char MAGIC[8] = { 'D', 'L', 'S', 'N', 'A', 'P', '1', '\0' };
+static const uint32_t VERSION = 1;
+
+//Writes raw values and keeps track of where everything lands
+class FileWriter
+{
+private:
+    ofstream out;
+    uint64_t position;
+
+public:
+    FileWriter(const string& path) : out(path, ios::binary | ios::trunc), position(0)
+    {
+        if (!out.is_open())
+        {
+            throw runtime_error("Couldn't write " + path);
+        }
+    }
+
+    uint64_t tell() const { return position; }
+
+    void write(const void* bytes, size_t size)
+    {
+        out.write(static_cast<const char*>(bytes), size);
+        position += size;
+    }
+
+    template<typename T>
+    void put(const T& value) { write(&value, sizeof(T)); }
+
+    //Pads so the next value starts on an 8 byte boundary
+    void align()
+    {
+        static const char zeros[8] = {};
+        write(zeros, (8 - position % 8) % 8);
+    }
+
+    void seek(uint64_t to)
+    {
+        out.seekp(to);
+        position = to;
+    }
+
+    //False if any write failed, including the ones still buffered
+    bool close()
+    {
+        out.close();
+        return !out.fail();
+    }
+};
+
+void DatabaseFile::save(const Database& database, const string& path)
+{
+    //Every string goes in the symbol table once, in sorted order
+    set<string> symbols;
+    for (auto& pair : database)
+    {
+        symbols.insert(pair.first);
+        for (const string& name : pair.second.getSchemeNames())
+        {
+            symbols.insert(name);
+        }
+
+        for (const Tuple& tuple : pair.second)
+        {
+            symbols.insert(tuple.begin(), tuple.end());
+        }
+    }
+
+    map<string, uint32_t> ids;
+    for (const string& value : symbols)
+    {
+        uint32_t id = ids.size();
+        ids[value] = id;
+    }
+
+    //Written to a temporary file and renamed over the path at the end, so a
+    //save that fails partway never leaves a file that opens
+    string temporary = path + ".tmp" + to_string(getpid());
+    FileWriter out(temporary);
+    Header header = {};
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.symbolCount = symbols.size();
+    header.relationCount = database.size();
+    out.put(header);
+
+    header.symbolOffsets = out.tell();
+    uint64_t offset = 0;
+    for (const string& value : symbols)
+    {
+        out.put(offset);
+        offset += value.size();
+    }
+    out.put(offset);
+
+    header.symbolData = out.tell();
+    for (const string& value : symbols)
+    {
+        out.write(value.data(), value.size());
+    }
+    out.align();
+
+    //Relations come out of the map sorted by name, so by name id too
+    vector<RelationEntry> entries;
+    for (auto& pair : database)
+    {
+        const Relation& relation = pair.second;
+
+        RelationEntry entry = {};
+        entry.name = ids.at(pair.first);
+        entry.arity = relation.getSchemeNames().size();
+        entry.tupleCount = relation.size();
+
+        entry.scheme = out.tell();
+        for (const string& name : relation.getSchemeNames())
+        {
+            out.put(ids.at(name));
+        }
+        out.align();
+
+        //The set hands the tuples over sorted already
+        entry.tuples = out.tell();
+        for (const Tuple& tuple : relation)
+        {
+            for (const string& value : tuple)
+            {
+                out.put(ids.at(value));
+            }
+        }
+        out.align();
+
+        entries.push_back(entry);
+    }
+
+    header.relations = out.tell();
+    for (RelationEntry& entry : entries)
+    {
+        out.put(entry);
+    }
+
+    out.seek(0);
+    out.put(header);
+
+    if (!out.close() || rename(temporary.c_str(), path.c_str()) != 0)
+    {
+        remove(temporary.c_str());
+        throw runtime_error("Couldn't write " + path);
+    }
+}
+
+DatabaseFile::DatabaseFile(const string& path) : data(nullptr), length(0), header(nullptr)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw runtime_error("Couldn't open " + path);
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) < 0 || info.st_size < (off_t)sizeof(Header))
+    {
+        close(fd);
+        throw runtime_error(path + " is not a database file");
+    }
+
+    length = info.st_size;
+    void* mapped = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (mapped == MAP_FAILED)
+    {
+        throw runtime_error("Couldn't map " + path);
+    }
+
+    data = static_cast<const char*>(mapped);
+    header = at<Header>(0);
+
+    if (!valid())
+    {
+        munmap(const_cast<char*>(data), length);
+        throw runtime_error(path + " is not a database file");
+    }
+}
+
+bool DatabaseFile::fits(uint64_t offset, uint64_t count, uint64_t size) const
+{
+    return offset <= length && (size == 0 || count <= (length - offset) / size);
+}
+
+//Everything the lookups read has to be inside the file, so a damaged one is
+//turned away here instead of being read out of range later
+bool DatabaseFile::valid() const
+{
+    if (memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 || header->version != VERSION
+        || header->symbolOffsets % 8 != 0 || !fits(header->symbolOffsets, header->symbolCount + 1ULL, sizeof(uint64_t))
+        || header->relations % 8 != 0 || !fits(header->relations, header->relationCount, sizeof(RelationEntry)))
+    {
+        return false;
+    }
+
+    const uint64_t* offsets = at<uint64_t>(header->symbolOffsets);
+    if (offsets[0] != 0 || !fits(header->symbolData, offsets[header->symbolCount], 1))
+    {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < header->symbolCount; i++)
+    {
+        if (offsets[i] > offsets[i + 1])
+        {
+            return false;
+        }
+    }
+
+    const RelationEntry* entries = at<RelationEntry>(header->relations);
+    for (uint32_t i = 0; i < header->relationCount; i++)
+    {
+        const RelationEntry& entry = entries[i];
+        if (entry.name >= header->symbolCount || entry.scheme % 4 != 0 || entry.tuples % 4 != 0
+            || !fits(entry.scheme, entry.arity, sizeof(uint32_t))
+            || !fits(entry.tuples, entry.tupleCount, entry.arity * sizeof(uint32_t)))
+        {
+            return false;
+        }
+
+        const uint32_t* scheme = at<uint32_t>(entry.scheme);
+        for (uint32_t j = 0; j < entry.arity; j++)
+        {
+            if (scheme[j] >= header->symbolCount)
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+DatabaseFile::~DatabaseFile()
+{
+    munmap(const_cast<char*>(data), length);
+}
+
+string DatabaseFile::symbol(uint32_t id) const
+{
+    //Rows aren't checked when the file is opened, that would mean reading
+    //all of them
+    if (id >= header->symbolCount)
+    {
+        throw runtime_error("The database file has a bad symbol id");
+    }
+
+    const uint64_t* offsets = at<uint64_t>(header->symbolOffsets);
+    return string(data + header->symbolData + offsets[id], offsets[id + 1] - offsets[id]);
+}
+
+bool DatabaseFile::findSymbol(const string& value, uint32_t& id) const
+{
+    uint32_t low = 0;
+    uint32_t high = header->symbolCount;
+
+    while (low < high)
+    {
+        uint32_t middle = low + (high - low) / 2;
+        int compared = symbol(middle).compare(value);
+
+        if (compared == 0)
+        {
+            id = middle;
+            return true;
+        }
+
+        if (compared < 0)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    return false;
+}
+
+const DatabaseFile::RelationEntry* DatabaseFile::findRelation(const string& name) const
+{
+    uint32_t id;
+    if (!findSymbol(name, id))
+    {
+        return nullptr;
+    }
+
+    const RelationEntry* entries = at<RelationEntry>(header->relations);
+    const RelationEntry* end = entries + header->relationCount;
+    const RelationEntry* entry = lower_bound(entries, end, id, [](const RelationEntry& e, uint32_t name) {
+        return e.name < name;
+    });
+
+    return entry != end && entry->name == id ? entry : nullptr;
+}
+
+bool DatabaseFile::hasRelation(const string& name) const
+{
+    return findRelation(name) != nullptr;
+}
+
+int DatabaseFile::relationCount() const
+{
+    return header->relationCount;
+}
+
+Relation DatabaseFile::lookup(const Predicate& query) const
+{
+    const RelationEntry* entry = findRelation(query.getName());
+    if (entry == nullptr)
+    {
+        throw invalid_argument("There is no scheme named " + query.getName());
+    }
+
+    vector<Parameter> params = query.getParams();
+    if (params.size() != entry->arity)
+    {
+        throw invalid_argument("The query must have the same size as the scheme");
+    }
+
+    vector<string> schemeNames;
+    const uint32_t* scheme = at<uint32_t>(entry->scheme);
+    for (uint32_t i = 0; i < entry->arity; i++)
+    {
+        schemeNames.push_back(symbol(scheme[i]));
+    }
+
+    Relation result(query.getName(), Scheme(schemeNames));
+
+    //The constants as ids. One that isn't in the file can't match anything
+    vector<int> columns;
+    vector<uint32_t> values;
+    for (unsigned int i = 0; i < params.size(); i++)
+    {
+        if (params.at(i).isId)
+        {
+            continue;
+        }
+
+        uint32_t id;
+        if (!findSymbol(params.at(i).value, id))
+        {
+            return result;
+        }
+
+        columns.push_back(i);
+        values.push_back(id);
+    }
+
+    //The leading constants narrow it down to a range of rows
+    unsigned int prefix = 0;
+    while (prefix < columns.size() && columns.at(prefix) == (int)prefix)
+    {
+        prefix++;
+    }
+
+    const uint32_t* rows = at<uint32_t>(entry->tuples);
+    uint32_t arity = entry->arity;
+
+    auto comparePrefix = [&](uint64_t row) {
+        for (unsigned int i = 0; i < prefix; i++)
+        {
+            uint32_t value = rows[row * arity + i];
+            if (value != values.at(i))
+            {
+                return value < values.at(i) ? -1 : 1;
+            }
+        }
+
+        return 0;
+    };
+
+    uint64_t low = 0;
+    uint64_t high = entry->tupleCount;
+    while (low < high)
+    {
+        uint64_t middle = low + (high - low) / 2;
+        if (comparePrefix(middle) < 0)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    for (uint64_t row = low; row < entry->tupleCount && comparePrefix(row) == 0; row++)
+    {
+        bool matches = true;
+        for (unsigned int i = prefix; i < columns.size() && matches; i++)
+        {
+            matches = rows[row * arity + columns.at(i)] == values.at(i);
+        }
+
+        if (!matches)
+        {
+            continue;
+        }
+
+        vector<string> tuple;
+        for (uint32_t i = 0; i < arity; i++)
+        {
+            tuple.push_back(symbol(rows[row * arity + i]));
+        }
+
+        result.addTuple(Tuple(tuple));
+    }
+
+    return result;
+}
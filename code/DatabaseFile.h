@@ -0,0 +1,74 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "Database.h"
+#include "Relation.h"
+#include "Predicate.h"
+
+using namespace std;
+
+//A saved database that gets memory mapped read only, so opening it costs the
+//same no matter how big it is. Every string is stored once in a sorted symbol
+//table and tuples are rows of symbol ids. Since the ids sort the same way as
+//the strings, each relation's rows are stored sorted and queries with leading
+//constants binary search straight to their rows
+class DatabaseFile
+{
+private:
+    struct Header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t symbolCount;
+        uint32_t relationCount;
+        uint32_t unused;
+        uint64_t symbolOffsets;
+        uint64_t symbolData;
+        uint64_t relations;
+    };
+
+    //The relations are sorted by name id
+    struct RelationEntry
+    {
+        uint32_t name;
+        uint32_t arity;
+        uint64_t tupleCount;
+        uint64_t scheme;
+        uint64_t tuples;
+    };
+
+    const char* data;
+    size_t length;
+    const Header* header;
+
+    bool fits(uint64_t offset, uint64_t count, uint64_t size) const;
+    bool valid() const;
+
+    string symbol(uint32_t id) const;
+    bool findSymbol(const string& value, uint32_t& id) const;
+    const RelationEntry* findRelation(const string& name) const;
+
+    template<typename T>
+    const T* at(uint64_t offset) const
+    {
+        return reinterpret_cast<const T*>(data + offset);
+    }
+
+public:
+    DatabaseFile(const string& path);
+    ~DatabaseFile();
+
+    DatabaseFile(const DatabaseFile&) = delete;
+    DatabaseFile& operator=(const DatabaseFile&) = delete;
+
+    static void save(const Database& database, const string& path);
+
+    bool hasRelation(const string& name) const;
+    int relationCount() const;
+
+    //The relation's tuples that match the query's constants, only the rows
+    //that match get turned back into strings
+    Relation lookup(const Predicate& query) const;
+};
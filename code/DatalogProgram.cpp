@@ -99,6 +99,21 @@ void DatalogProgram::addFact(Predicate& fact)
     facts.push_back(fact);
 }
 
+//Removes the first fact with the same name and values, returns false if there wasn't one
+bool DatalogProgram::removeFact(const Predicate& fact)
+{
+    for (unsigned int i = 0; i < facts.size(); i++)
+    {
+        if (facts.at(i).getName() == fact.getName() && facts.at(i).getParamNames() == fact.getParamNames())
+        {
+            facts.erase(facts.begin() + i);
+            return true;
+        }
+    }
+
+    return false;
+}
+
 void DatalogProgram::addQuerie(Predicate& query)
 {
     queries.push_back(query);
@@ -30,6 +30,7 @@ public:
 
     void addScheme(Predicate& scheme);
     void addFact(Predicate& fact);
+    bool removeFact(const Predicate& fact);
     void addQuerie(Predicate& query);
     void addRule(Rule& rule);
     
@@ -0,0 +1,472 @@
+#include "ExternalRelation.h"
+#include "BinaryIO.h"
+#include "TupleKey.h"
+#include <string>
+#include <vector>
+#include <set>
+#include <queue>
+#include <memory>
+#include <fstream>
+#include <atomic>
+#include <cstdio>
+#include <stdexcept>
+#include <unordered_map>
+#include <algorithm>
+#include <unistd.h>
+
+using namespace std;
+
+//Writes tuples of a known arity one after another
+static void putTuple(ostream& out, const Tuple& tuple)
+{
+    for (const string& value : tuple)
+    {
+        putString(out, value);
+    }
+}
+
+static bool getTuple(istream& in, unsigned arity, vector<string>& values)
+{
+    values.resize(arity);
+    for (unsigned i = 0; i < arity; i++)
+    {
+        if (!getString(in, values[i]))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void openFile(ofstream& out, const string& path)
+{
+    out.open(path, ios::binary | ios::trunc);
+    if (!out.is_open())
+    {
+        throw runtime_error("Couldn't write " + path);
+    }
+}
+
+static void openFile(ifstream& in, const string& path)
+{
+    in.open(path, ios::binary);
+    if (!in.is_open())
+    {
+        throw runtime_error("Couldn't read " + path);
+    }
+}
+
+static void closeFile(ofstream& out, const string& path)
+{
+    out.close();
+    if (!out)
+    {
+        throw runtime_error("Couldn't write " + path);
+    }
+}
+
+//Spill files that get removed when this goes out of scope, including when
+//an I/O error is unwinding past them
+class TemporaryFiles
+{
+private:
+    vector<string> paths;
+
+public:
+    TemporaryFiles() {}
+    ~TemporaryFiles()
+    {
+        for (const string& path : paths)
+        {
+            remove(path.c_str());
+        }
+    }
+
+    TemporaryFiles(const TemporaryFiles&) = delete;
+    TemporaryFiles& operator=(const TemporaryFiles&) = delete;
+
+    const string& add(const string& path)
+    {
+        paths.push_back(path);
+        return paths.back();
+    }
+
+    //The files are in use now, someone else removes them
+    void keep()
+    {
+        paths.clear();
+    }
+};
+
+ExternalRelation::ExternalRelation(const string& name, const Scheme& scheme, size_t budget, const string& directory)
+    : name(name), scheme(scheme), budget(budget), directory(directory), bufferBytes(0)
+{
+}
+
+ExternalRelation::ExternalRelation(const Relation& relation, size_t budget, const string& directory)
+    : ExternalRelation(relation.getName(), relation.getSchemeNames(), budget, directory)
+{
+    for (const Tuple& tuple : relation)
+    {
+        addTuple(tuple);
+    }
+}
+
+ExternalRelation::~ExternalRelation()
+{
+    for (const string& run : runs)
+    {
+        remove(run.c_str());
+    }
+}
+
+string ExternalRelation::spillPath() const
+{
+    static atomic<long> files(0);
+    return directory + "/datalog-spill." + to_string(getpid()) + "." + to_string(files++);
+}
+
+void ExternalRelation::addTuple(const Tuple& tuple)
+{
+    if (buffer.insert(tuple).second)
+    {
+        bufferBytes += Relation::tupleBytes(tuple);
+        if (bufferBytes > budget)
+        {
+            spill();
+        }
+    }
+}
+
+void ExternalRelation::spill()
+{
+    string path = spillPath();
+    ofstream out;
+    openFile(out, path);
+    runs.push_back(path);
+
+    for (const Tuple& tuple : buffer)
+    {
+        putTuple(out, tuple);
+    }
+    closeFile(out, path);
+
+    set<Tuple>().swap(buffer);
+    bufferBytes = 0;
+
+    //Merging reads every run at once, so they're kept to a few open files
+    if (runs.size() >= MAX_RUNS)
+    {
+        mergeRuns();
+    }
+}
+
+//Merges the runs into one, with the buffer empty
+void ExternalRelation::mergeRuns()
+{
+    TemporaryFiles merged;
+    string path = merged.add(spillPath());
+    ofstream out;
+    openFile(out, path);
+
+    forEach([&](const Tuple& tuple) {
+        putTuple(out, tuple);
+    });
+    closeFile(out, path);
+
+    for (const string& run : runs)
+    {
+        remove(run.c_str());
+    }
+    runs = {path};
+    merged.keep();
+}
+
+//A k-way merge of the runs and the buffer, skipping the copies of a tuple
+//that more than one of them has
+void ExternalRelation::forEach(const function<void(const Tuple&)>& visit) const
+{
+    if (runs.empty())
+    {
+        for (const Tuple& tuple : buffer)
+        {
+            visit(tuple);
+        }
+        return;
+    }
+
+    struct Source
+    {
+        ifstream in;
+        vector<string> current;
+    };
+
+    vector<unique_ptr<Source>> sources;
+    for (const string& run : runs)
+    {
+        sources.push_back(make_unique<Source>());
+        openFile(sources.back()->in, run);
+    }
+
+    //The buffer is the source past the last run
+    auto bufferIt = buffer.begin();
+    auto advance = [&](unsigned index) -> bool
+    {
+        if (index == sources.size())
+        {
+            return bufferIt != buffer.end();
+        }
+
+        return getTuple(sources[index]->in, scheme.size(), sources[index]->current);
+    };
+    auto current = [&](unsigned index) -> const vector<string>&
+    {
+        return index == sources.size() ? static_cast<const vector<string>&>(*bufferIt) : sources[index]->current;
+    };
+
+    auto later = [&](unsigned a, unsigned b) { return current(a) > current(b); };
+    priority_queue<unsigned, vector<unsigned>, decltype(later)> heap(later);
+    for (unsigned i = 0; i <= sources.size(); i++)
+    {
+        if (advance(i))
+        {
+            heap.push(i);
+        }
+    }
+
+    vector<string> previous;
+    bool first = true;
+    while (!heap.empty())
+    {
+        unsigned index = heap.top();
+        heap.pop();
+
+        if (first || current(index) != previous)
+        {
+            previous = current(index);
+            visit(Tuple(previous));
+            first = false;
+        }
+
+        if (index == sources.size())
+        {
+            bufferIt++;
+        }
+        if (advance(index))
+        {
+            heap.push(index);
+        }
+    }
+}
+
+Relation ExternalRelation::project(const vector<string>& columns) const
+{
+    vector<int> positions;
+    for (const string& column : columns)
+    {
+        for (unsigned i = 0; i < scheme.size(); i++)
+        {
+            if (scheme.at(i) == column)
+            {
+                positions.push_back(i);
+            }
+        }
+    }
+
+    vector<string> names;
+    for (int position : positions)
+    {
+        names.push_back(scheme.at(position));
+    }
+
+    Relation result(name, Scheme(names));
+    if (positions.empty())
+    {
+        return result;
+    }
+
+    forEach([&](const Tuple& tuple) {
+        result.addTuple(copyColumns(tuple, positions));
+    });
+
+    return result;
+}
+
+const Scheme& ExternalRelation::getScheme() const
+{
+    return scheme;
+}
+
+//Counts the matches through a hash of the right side's keys. Hash collisions
+//only make the count high
+size_t ExternalRelation::joinBytes(const Relation& left, const Relation& right)
+{
+    if (left.size() == 0 || right.size() == 0)
+    {
+        return 0;
+    }
+
+    TupleKey key = Relation::joinKey(left.scheme, right.scheme);
+    vector<int> rightColumns = Relation::rightOnlyColumns(left.scheme, right.scheme);
+
+    unordered_map<size_t, size_t> counts;
+    for (const Tuple& tuple : right)
+    {
+        counts[key.hashRight(tuple)]++;
+    }
+
+    size_t matches = 0;
+    for (const Tuple& tuple : left)
+    {
+        auto it = counts.find(key.hashLeft(tuple));
+        if (it != counts.end())
+        {
+            matches += it->second;
+        }
+    }
+
+    Tuple sample = Relation::joinTuples(*left.begin(), *right.begin(), rightColumns);
+    return matches * Relation::tupleBytes(sample);
+}
+
+Scheme ExternalRelation::joinScheme(const Scheme& left, const Scheme& right)
+{
+    Scheme result = left;
+    for (int column : Relation::rightOnlyColumns(left, right))
+    {
+        result.push_back(right.at(column));
+    }
+
+    return result;
+}
+
+void ExternalRelation::join(const ExternalRelation& left, const Relation& right, ExternalRelation& result)
+{
+    size_t rightBytes = 0;
+    for (const Tuple& tuple : right)
+    {
+        rightBytes += Relation::tupleBytes(tuple) + 16;
+    }
+
+    if (rightBytes > left.budget / 2)
+    {
+        partitionedJoin(left, right, result);
+        return;
+    }
+
+    TupleKey key = Relation::joinKey(left.scheme, right.scheme);
+    vector<int> rightColumns = Relation::rightOnlyColumns(left.scheme, right.scheme);
+
+    unordered_multimap<size_t, const Tuple*> table;
+    for (const Tuple& tuple : right)
+    {
+        table.emplace(key.hashRight(tuple), &tuple);
+    }
+
+    left.forEach([&](const Tuple& leftTuple) {
+        auto range = table.equal_range(key.hashLeft(leftTuple));
+        for (auto it = range.first; it != range.second; it++)
+        {
+            if (key.matches(leftTuple, *it->second))
+            {
+                result.addTuple(Relation::joinTuples(leftTuple, *it->second, rightColumns));
+            }
+        }
+    });
+}
+
+void ExternalRelation::partitionedJoin(const ExternalRelation& left, const Relation& right, ExternalRelation& result)
+{
+    TupleKey key = Relation::joinKey(left.scheme, right.scheme);
+    vector<int> rightColumns = Relation::rightOnlyColumns(left.scheme, right.scheme);
+
+    size_t rightBytes = 0;
+    for (const Tuple& tuple : right)
+    {
+        rightBytes += Relation::tupleBytes(tuple) + 16;
+    }
+
+    //Enough partitions that each right one fits in half the budget
+    size_t partitions = 1;
+    while (rightBytes / partitions > left.budget / 2 && partitions < MAX_PARTITIONS)
+    {
+        partitions *= 2;
+    }
+
+    //Only so many files can be open at once, so the partitions get written
+    //and joined a batch at a time, each batch reading both sides again
+    for (size_t first = 0; first < partitions; first += PARTITIONS_PER_PASS)
+    {
+        size_t count = min(partitions - first, PARTITIONS_PER_PASS);
+
+        TemporaryFiles files;
+        vector<string> leftPaths;
+        vector<string> rightPaths;
+        {
+            vector<unique_ptr<ofstream>> leftFiles;
+            vector<unique_ptr<ofstream>> rightFiles;
+            for (size_t i = 0; i < count; i++)
+            {
+                leftPaths.push_back(files.add(left.spillPath()));
+                rightPaths.push_back(files.add(left.spillPath()));
+                leftFiles.push_back(make_unique<ofstream>());
+                rightFiles.push_back(make_unique<ofstream>());
+                openFile(*leftFiles.back(), leftPaths.back());
+                openFile(*rightFiles.back(), rightPaths.back());
+            }
+
+            left.forEach([&](const Tuple& tuple) {
+                size_t partition = key.hashLeft(tuple) & (partitions - 1);
+                if (partition >= first && partition < first + count)
+                {
+                    putTuple(*leftFiles[partition - first], tuple);
+                }
+            });
+            for (const Tuple& tuple : right)
+            {
+                size_t partition = key.hashRight(tuple) & (partitions - 1);
+                if (partition >= first && partition < first + count)
+                {
+                    putTuple(*rightFiles[partition - first], tuple);
+                }
+            }
+
+            for (size_t i = 0; i < count; i++)
+            {
+                closeFile(*leftFiles[i], leftPaths[i]);
+                closeFile(*rightFiles[i], rightPaths[i]);
+            }
+        }
+
+        for (size_t i = 0; i < count; i++)
+        {
+            vector<Tuple> rightTuples;
+            unordered_multimap<size_t, size_t> table;
+            ifstream rightIn;
+            openFile(rightIn, rightPaths[i]);
+            vector<string> values;
+            while (getTuple(rightIn, right.scheme.size(), values))
+            {
+                table.emplace(key.hashRight(Tuple(values)), rightTuples.size());
+                rightTuples.push_back(Tuple(values));
+            }
+
+            ifstream leftIn;
+            openFile(leftIn, leftPaths[i]);
+            while (getTuple(leftIn, left.scheme.size(), values))
+            {
+                Tuple leftTuple(values);
+                auto range = table.equal_range(key.hashLeft(leftTuple));
+                for (auto it = range.first; it != range.second; it++)
+                {
+                    const Tuple& rightTuple = rightTuples[it->second];
+                    if (key.matches(leftTuple, rightTuple))
+                    {
+                        result.addTuple(Relation::joinTuples(leftTuple, rightTuple, rightColumns));
+                    }
+                }
+            }
+        }
+    }
+}
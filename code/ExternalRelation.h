@@ -0,0 +1,69 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <set>
+#include <functional>
+#include "Relation.h"
+#include "Scheme.h"
+#include "Tuple.h"
+
+using namespace std;
+
+//A relation that keeps at most about budget bytes of tuples in memory. Past
+//that the tuples in memory get written out as a sorted run and dropped, and
+//reading goes through a merge of the runs with what's left in memory (an
+//external merge sort). Used for the intermediate results of a rule that
+//won't fit under --memory-limit
+class ExternalRelation
+{
+private:
+    string name;
+    Scheme scheme;
+    size_t budget;
+    string directory;
+
+    set<Tuple> buffer;
+    size_t bufferBytes;
+    vector<string> runs;
+
+    //Keeps the files open at once well under the usual limit of 1024
+    static constexpr size_t MAX_RUNS = 64;
+    static constexpr size_t MAX_PARTITIONS = 4096;
+    static constexpr size_t PARTITIONS_PER_PASS = 64;
+
+    void spill();
+    void mergeRuns();
+    string spillPath() const;
+
+    //Grace hash join, for a right side too big to hash in memory. Both sides
+    //get split into files by the hash of the key, then joined file by file
+    static void partitionedJoin(const ExternalRelation& left, const Relation& right, ExternalRelation& result);
+
+public:
+    ExternalRelation(const string& name, const Scheme& scheme, size_t budget, const string& directory);
+    ExternalRelation(const Relation& relation, size_t budget, const string& directory);
+    ~ExternalRelation();
+
+    ExternalRelation(const ExternalRelation&) = delete;
+    ExternalRelation& operator=(const ExternalRelation&) = delete;
+
+    void addTuple(const Tuple& tuple);
+
+    //Every tuple once, in order
+    void forEach(const function<void(const Tuple&)>& visit) const;
+
+    //The projection has to fit in memory, it's what the rule adds
+    Relation project(const vector<string>& columns) const;
+
+    const Scheme& getScheme() const;
+
+    //Roughly what joining the two would take up, counted before joining
+    static size_t joinBytes(const Relation& left, const Relation& right);
+
+    //Joins on the shared column names into result, which should have the
+    //scheme joinScheme gives. The right side gets hashed in memory if it
+    //fits in half the budget
+    static Scheme joinScheme(const Scheme& left, const Scheme& right);
+    static void join(const ExternalRelation& left, const Relation& right, ExternalRelation& result);
+};
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "Relation.h"
+#include "Predicate.h"
+
+using namespace std;
+
+//A read only relation kept in a compact form (by column, or as a trie) that
+//the rules and queries read through selects
+class FrozenRelation
+{
+public:
+    virtual ~FrozenRelation() {}
+
+    //The rows matching a predicate's constants and repeated variables, with
+    //every column. Given the relation it's about to be joined with, rows
+    //without a match on the shared variables can be left out
+    virtual Relation select(const Predicate& predicate, const Relation* joinWith = nullptr) const = 0;
+
+    virtual Relation decode() const = 0;
+
+    virtual size_t size() const = 0;
+    virtual size_t bytes() const = 0;
+};
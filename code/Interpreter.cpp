@@ -5,22 +5,63 @@
 #include "Query.h"
 #include "Graph.h"
 #include "SCC.h"
+#include "MagicSets.h"
+#include "BinaryIO.h"
+#include "ColumnarRelation.h"
+#include "TrieRelation.h"
+#include "ExternalRelation.h"
+#include "MemoryReport.h"
+#include "Arena.h"
+#include "OutputBuffer.h"
 #include <map>
+#include <set>
 #include <string>
+#include <sstream>
+#include <atomic>
+#include <functional>
+#include <algorithm>
+#include <deque>
 
 using namespace std;
 
-Interpreter::Interpreter(DatalogProgram datalogProgram)
+Interpreter::Interpreter(DatalogProgram datalogProgram, Options options) : options(options), pool(options.threads), versioned(false)
 {
     this->datalogProgram = datalogProgram;
+    this->queries = datalogProgram.getQueries();
+
+    if (options.memoryReport)
+    {
+        memory = make_unique<MemoryReport>();
+        MemoryReport::listen();
+    }
+
+    //The rewritten queries point at the adorned relations, but get printed
+    //the way they were asked
+    if (options.magic)
+    {
+        this->datalogProgram = MagicSets(datalogProgram).rewrite();
+    }
 }
 
 void Interpreter::run() 
 {
+    //Made here rather than in the constructor so a directory that can't be
+    //created gets reported like any other failure of the run
+    if (!options.cacheDir.empty())
+    {
+        cache = make_unique<ResultCache>(options.cacheDir);
+    }
+
     evaluateSchemes();
     evaluateFacts();
     evaluateRules();
     evaluateQueries();
+
+    if (memory != nullptr)
+    {
+        measureRelations();
+        cerr << memory->toString();
+    }
 }
 
 void Interpreter::evaluateSchemes() 
@@ -29,225 +70,1366 @@ void Interpreter::evaluateSchemes()
     //Make the schemes
     for (auto& dpScheme : datalogProgram.getSchemes())
     {
-        string name = dpScheme.getName();
+        string name = dpScheme.getName();
+
+        Scheme scheme(dpScheme.getParamNames());
+        Relation relation(name, scheme);
+
+        relations.insert(pair<string, Relation>(name,relation));
+    }
+
+    database = Database(relations);
+}
+
+void Interpreter::evaluateFacts()
+{
+    for (auto& fact : datalogProgram.getFacts()) {
+        string name = fact.getName();
+        Relation& relation = database.getRelation(name);
+        Tuple tuple(fact.getParamNames());
+        relation.addTuple(tuple);
+    }
+}
+
+void Interpreter::evaluateRules()
+{
+    // Build the dependency graph.
+    Graph dependencyGraph = Interpreter::makeGraph(datalogProgram.getRules());
+
+    if (tracing())
+    {
+        cout << "Dependency Graph" << '\n' << dependencyGraph.toString() << '\n';
+    }
+
+    //Build the reverse dependency graph.
+    Graph reverseGraph = Interpreter::makeGraph(datalogProgram.getRules(), true);
+
+    //Run DFS-Forest on the reverse dependency graph.
+    stack<int> postOrders = Interpreter::dfsForest(reverseGraph);
+
+    //Find the strongly connected components (SCCs).
+    vector<SCC> sccs = findSCC(postOrders, dependencyGraph);
+
+    if (options.prune)
+    {
+        sccs = pruneSCCs(sccs, dependencyGraph);
+    }
+
+    if (options.columnar || options.trie)
+    {
+        freezeBaseRelations();
+    }
+
+    if (memory != nullptr)
+    {
+        measureRelations();
+    }
+
+    //Kept around for propagating facts added later
+    this->sccs = sccs;
+    
+    //Evaluate the rules in each component.
+    evaluateRulesWithSCC(sccs, dependencyGraph);
+}
+
+//Measures the SCC's relations at the end of a pass, and counts the largest
+//intermediate of the pass toward the SCC
+void Interpreter::measure(const SCC& scc)
+{
+    size_t total = 0;
+    for (const Relation* output : sccOutputs(scc))
+    {
+        size_t bytes = output->bytes();
+        memory->relation(output->getName(), bytes);
+        total += bytes;
+    }
+    memory->scc(scc.getName(), total + MemoryReport::takePassPeak());
+
+    if (MemoryReport::takeRequest())
+    {
+        cerr << memory->toString();
+    }
+}
+
+void Interpreter::measureRelations()
+{
+    for (auto& pair : database)
+    {
+        auto it = frozen.find(pair.first);
+        bool isFrozen = it != frozen.end() && it->second != nullptr;
+        memory->relation(pair.first, isFrozen ? it->second->bytes() : pair.second.bytes());
+    }
+}
+
+//Moves the relations no rule derives into to column or trie storage, they
+//only get read from here on
+void Interpreter::freezeBaseRelations()
+{
+    set<string> heads;
+    for (Rule& rule : datalogProgram.getRules())
+    {
+        heads.insert(rule.getName());
+    }
+
+    for (auto& pair : database)
+    {
+        if (heads.count(pair.first) == 0)
+        {
+            if (options.trie)
+            {
+                frozen[pair.first] = make_unique<TrieRelation>(pair.second);
+            }
+            else
+            {
+                frozen[pair.first] = make_unique<ColumnarRelation>(pair.second);
+            }
+            pair.second.clear();
+        }
+    }
+}
+
+//Drops the SCCs no query depends on, along with the relations only they use.
+//An SCC is either reachable as a whole or not at all
+vector<SCC> Interpreter::pruneSCCs(const vector<SCC>& sccs, Graph& dependencyGraph)
+{
+    set<int> live = reachableRules(dependencyGraph, datalogProgram.getRules(), datalogProgram.getQueries());
+
+    vector<SCC> result;
+    set<string> liveRelations;
+    for (const SCC& scc : sccs)
+    {
+        if (live.count(scc.getIds().at(0)) == 0)
+        {
+            continue;
+        }
+
+        result.push_back(scc);
+        for (const string& name : relationsUsed(scc))
+        {
+            liveRelations.insert(name);
+        }
+    }
+
+    for (Predicate& query : datalogProgram.getQueries())
+    {
+        liveRelations.insert(query.getName());
+    }
+
+    for (auto it = database.begin(); it != database.end(); )
+    {
+        it = liveRelations.count(it->first) > 0 ? next(it) : database.erase(it);
+    }
+
+    return result;
+}
+
+void Interpreter::evaluateRulesWithSCC(vector<SCC> sccs, Graph& dependencyGraph)
+{
+    //Below Trace nothing of this gets printed
+    ostream none(nullptr);
+    ostream& out = tracing() ? cout : none;
+    out << "Rule Evaluation" << '\n';
+
+    if (options.release)
+    {
+        countRelationUsers(sccs);
+    }
+
+    if (!options.checkpointFile.empty())
+    {
+        startCheckpoint();
+    }
+
+    //The checkpoint records the SCCs one after the other, so with one they
+    //run in order even given threads
+    if (pool.size() > 1 && checkpoint == nullptr)
+    {
+        evaluateSCCsConcurrently(sccs, dependencyGraph);
+    }
+    else
+    {
+        for (unsigned int i = 0; i < sccs.size(); i++)
+        {
+            evaluateSCC(sccs.at(i), out, i);
+        }
+    }
+
+    checkpoint.reset();
+    resumed = Progress();
+
+    out << '\n';
+}
+
+//Opens the checkpoint log, first reading back what it has when resuming
+void Interpreter::startCheckpoint()
+{
+    //Identifies the program, a log from a different one can't be resumed.
+    //Jacobi passes run and print differently, and traces logged at one
+    //output level can't be printed at another
+    bool jacobi = options.jacobi && pool.size() > 1;
+    unsigned long long key = hashText(datalogProgram.toString() + (options.prune ? "prune" : "") + (jacobi ? "jacobi" : "")
+        + (tracing() ? "" : "untraced"));
+
+    if (options.resume && !Checkpoint::load(options.checkpointFile, key, database, resumed))
+    {
+        cerr << "No checkpoint of this program in " << options.checkpointFile << ", starting over" << endl;
+        resumed = Progress();
+    }
+
+    checkpoint = make_unique<Checkpoint>(options.checkpointFile, key, options.checkpointInterval, resumed);
+}
+
+bool Interpreter::tracing() const
+{
+    return options.verbosity == Verbosity::Trace;
+}
+
+void Interpreter::evaluateSCC(SCC scc, ostream& out, int index)
+{
+    bool resuming = index >= 0 && index <= resumed.lastScc;
+
+    //Keyed before evaluating, on the relations as they are coming in
+    string key;
+    if (cache != nullptr && index >= 0 && !resuming)
+    {
+        key = cacheKey(scc);
+
+        string cached;
+        if (cache->load(key, database, cached))
+        {
+            out << cached;
+            if (checkpoint != nullptr)
+            {
+                for (const Relation* output : sccOutputs(scc))
+                {
+                    checkpoint->addTuples(*output);
+                }
+                checkpoint->addTrace(cached);
+                checkpoint->sccDone(index, 0);
+            }
+
+            if (options.release)
+            {
+                releaseRelations(scc);
+            }
+            return;
+        }
+    }
+
+    //With a checkpoint or a cache each pass's trace goes through here so it
+    //can be logged, and the whole of it kept for the cache
+    stringstream text;
+    string whole;
+    bool capture = checkpoint != nullptr || !key.empty();
+    ostream& trace = capture ? text : out;
+    auto record = [&]()
+    {
+        if (capture)
+        {
+            out << text.str();
+            whole += text.str();
+            if (checkpoint != nullptr)
+            {
+                checkpoint->addTrace(text.str());
+            }
+            text.str("");
+        }
+    };
+
+    int i = 0;
+    if (resuming)
+    {
+        //Resuming, an SCC the log has finished only gets its trace printed
+        //again, the one it stopped in continues after its last logged pass
+        out << resumed.traces[index];
+        if (index < resumed.lastScc || resumed.lastDone)
+        {
+            if (options.release)
+            {
+                releaseRelations(scc);
+            }
+            return;
+        }
+
+        i = resumed.lastPasses;
+    }
+    else
+    {
+        trace << scc.toString() << '\n';
+    }
+
+    bool changed = true;
+    while (changed)
+    {
+        //Only evaluate scc that aren't rule dependent once (have one rule not itself)
+        if (!scc.isRuleDependent() && i > 0)
+        {
+            break;
+        }
+
+        i++;
+        changed = evaluateRule(scc, trace);
+
+        record();
+        if (memory != nullptr)
+        {
+            measure(scc);
+        }
+        if (checkpoint != nullptr && changed)
+        {
+            checkpoint->passDone(index, i);
+        }
+    }
+
+    trace << i << " passes: " << scc.getName() << '\n';
+
+    record();
+    if (checkpoint != nullptr)
+    {
+        checkpoint->sccDone(index, i);
+    }
+
+    if (!key.empty())
+    {
+        cache->store(key, sccOutputs(scc), whole);
+    }
+
+    if (options.release)
+    {
+        releaseRelations(scc);
+    }
+}
+
+//The SCC's rules plus every relation it reads or writes, heads included
+//since facts can already be in them
+string Interpreter::cacheKey(const SCC& scc)
+{
+    stringstream rules;
+    rules << scc.toString() << '\n';
+    for (const Rule& rule : scc)
+    {
+        rules << rule.toString() << "." << '\n';
+    }
+
+    //Jacobi passes print differently, and without tracing there's no trace
+    //kept to print
+    if (options.jacobi && pool.size() > 1)
+    {
+        rules << "jacobi" << '\n';
+    }
+    if (!tracing())
+    {
+        rules << "untraced" << '\n';
+    }
+
+    vector<const Relation*> inputs;
+    deque<Relation> thawed;
+    for (const string& name : relationsUsed(scc))
+    {
+        auto it = frozen.find(name);
+        if (it != frozen.end() && it->second != nullptr)
+        {
+            thawed.push_back(it->second->decode());
+            inputs.push_back(&thawed.back());
+            continue;
+        }
+
+        inputs.push_back(&database.at(name));
+    }
+
+    return ResultCache::key(rules.str(), inputs);
+}
+
+vector<const Relation*> Interpreter::sccOutputs(const SCC& scc)
+{
+    set<string> heads;
+    for (const Rule& rule : scc)
+    {
+        heads.insert(rule.getName());
+    }
+
+    vector<const Relation*> outputs;
+    for (const string& head : heads)
+    {
+        outputs.push_back(&database.at(head));
+    }
+
+    return outputs;
+}
+
+//Relation liveness. Counts the SCCs that read or write each relation, the
+//queried ones are left out since they have to live until the end
+void Interpreter::countRelationUsers(const vector<SCC>& sccs)
+{
+    set<string> queried;
+    for (Predicate& query : datalogProgram.getQueries())
+    {
+        queried.insert(query.getName());
+    }
+
+    remainingUsers.clear();
+    for (const SCC& scc : sccs)
+    {
+        for (const string& name : relationsUsed(scc))
+        {
+            if (queried.count(name) == 0)
+            {
+                remainingUsers.emplace(name, 0);
+                remainingUsers.at(name)++;
+            }
+        }
+    }
+}
+
+//Counting instead of going by SCC order, so it also works when the SCCs run
+//concurrently and finish out of order
+void Interpreter::releaseRelations(const SCC& scc)
+{
+    for (const string& name : relationsUsed(scc))
+    {
+        auto users = remainingUsers.find(name);
+        if (users != remainingUsers.end() && --users->second == 0)
+        {
+            database.getRelation(name).clear();
+
+            auto it = frozen.find(name);
+            if (it != frozen.end())
+            {
+                it->second.reset();
+            }
+        }
+    }
+}
+
+set<string> Interpreter::relationsUsed(const SCC& scc)
+{
+    set<string> names;
+    for (const Rule& rule : scc)
+    {
+        names.insert(rule.getName());
+        for (Predicate& predicate : rule.getBodyPredicates())
+        {
+            names.insert(predicate.getName());
+        }
+    }
+
+    return names;
+}
+
+//Runs each SCC as soon as the SCCs it depends on are done. Every SCC writes to
+//its own buffer and the buffers are printed in the original order afterwards
+void Interpreter::evaluateSCCsConcurrently(const vector<SCC>& sccs, Graph& dependencyGraph)
+{
+    vector<set<int>> dependencies = sccDependencies(sccs, dependencyGraph);
+
+    vector<vector<int>> dependents(sccs.size());
+    vector<atomic<int>> waitingOn(sccs.size());
+    for (unsigned int i = 0; i < sccs.size(); i++)
+    {
+        waitingOn.at(i) = dependencies.at(i).size();
+        for (int dependency : dependencies.at(i))
+        {
+            dependents.at(dependency).push_back(i);
+        }
+    }
+
+    vector<stringstream> outputs(sccs.size());
+    TaskGroup group;
+
+    function<void(int)> start = [&](int index) {
+        pool.spawn(group, [&, index] {
+            evaluateSCC(sccs.at(index), outputs.at(index), index);
+
+            for (int dependent : dependents.at(index))
+            {
+                if (--waitingOn.at(dependent) == 0)
+                {
+                    start(dependent);
+                }
+            }
+        });
+    };
+
+    for (unsigned int i = 0; i < sccs.size(); i++)
+    {
+        if (dependencies.at(i).empty())
+        {
+            start(i);
+        }
+    }
+
+    pool.wait(group);
+
+    if (!tracing())
+    {
+        return;
+    }
+
+    for (stringstream& output : outputs)
+    {
+        cout << output.str();
+    }
+}
+
+void Interpreter::evaluateRulesOld()
+{
+    cout << "Rule Evaluation" << '\n';
+    int i = 0;
+    do
+    {
+       i++;
+    } while (evaluateRule(datalogProgram.getRules()));
+
+    cout << '\n' << "Schemes populated after " << i << " passes through the Rules." << '\n' << '\n';
+}
+
+bool Interpreter::evaluateRule(vector<Rule> rules, ostream& out)
+{
+    if (options.jacobi && pool.size() > 1 && rules.size() > 1)
+    {
+        return evaluateRuleParallel(rules, out);
+    }
+
+    bool changed = false;
+    for (Rule& rule : rules)
+    {
+        if (tracing())
+        {
+            out << rule.toString() << '\n';
+        }
+
+        //With --arena the rule's intermediates come from this thread's arena
+        //and all go at once after it's done. What gets added to the database
+        //is allocated the usual way
+        ArenaScope scope(options.arena ? Arena::forThisThread() : nullptr);
+        Relation result = evaluateRuleBody(rule);
+
+        ArenaPause pause;
+        if (addRuleResult(move(result), out))
+        {
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+//Jacobi style pass: every rule reads the relations as they were at the start
+//of the pass, then the results get merged (and printed) in rule order
+bool Interpreter::evaluateRuleParallel(const vector<Rule>& rules, ostream& out)
+{
+    vector<Relation> results(rules.size(), Relation("", Scheme(vector<string>())));
+
+    pool.run(rules.size(), [&](int i) {
+        results.at(i) = evaluateRuleBody(rules.at(i));
+    });
+
+    bool changed = false;
+    for (unsigned int i = 0; i < rules.size(); i++)
+    {
+        if (tracing())
+        {
+            out << rules.at(i).toString() << '\n';
+        }
+
+        if (addRuleResult(results.at(i), out))
+        {
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+//Joins the body predicates and projects the head columns, without touching the database.
+//Given a delta, the body predicate at deltaIndex reads from it instead, and goes first
+//so the others only get probed for the tuples that join with it. Given a seed (named
+//by the head's variables), only the head tuples in it get derived, the same way
+Relation Interpreter::evaluateRuleBody(const Rule& rule, int deltaIndex, const Relation* delta, const Relation* seed)
+{
+    vector<Predicate> body = rule.getBodyPredicates();
+
+    vector<int> order;
+    if (deltaIndex >= 0)
+    {
+        order.push_back(deltaIndex);
+    }
+    for (unsigned int i = 0; i < body.size(); i++)
+    {
+        if ((int)i != deltaIndex)
+        {
+            order.push_back(i);
+        }
+    }
+
+    //Get an immediate result. Only the tuples with a match in what it's
+    //about to be joined with get copied (or decoded, for a frozen relation),
+    //unless that's the bigger side
+    auto evaluate = [&](unsigned int step, const Relation* joinWith)
+    {
+        int i = order.at(step);
+        int numResults;
+        auto it = frozen.find(body.at(i).getName());
+        if (i != deltaIndex && it != frozen.end() && it->second != nullptr)
+        {
+            return evaluatePredicate(it->second->select(body.at(i), joinWith), body.at(i), numResults);
+        }
+
+        const Relation& relation = i == deltaIndex ? *delta : database.getRelation(body.at(i).getName());
+        if (joinWith != nullptr && joinWith->size() >= relation.size())
+        {
+            joinWith = nullptr;
+        }
+
+        return evaluatePredicate(relation, body.at(i), numResults, joinWith);
+    };
+
+    //Each step's result gets measured with --memory-report
+    string label = memory != nullptr ? rule.toString() : "";
+    auto measure = [&](const string& step, const Relation& relation)
+    {
+        if (memory != nullptr)
+        {
+            memory->step(label + " " + step, relation.bytes());
+        }
+    };
+
+    //Join them
+    Relation result = seed != nullptr ? *seed : evaluate(0, nullptr);
+    result.setName(rule.getName());
+    measure(seed != nullptr ? "seed" : "predicate " + to_string(order.at(0)), result);
+    for (unsigned int i = seed != nullptr ? 0 : 1; i < body.size(); i++)
+    {
+        Relation next = evaluate(i, &result);
+        measure("predicate " + to_string(order.at(i)), next);
+
+        //A join that won't fit under the memory limit goes to disk, and so
+        //does the rest of the rule after it
+        if (options.memoryLimit > 0 && ExternalRelation::joinBytes(result, next) > options.memoryLimit)
+        {
+            unique_ptr<ExternalRelation> joined = make_unique<ExternalRelation>(result, options.memoryLimit, options.spillDir);
+            for (unsigned int j = i; j < body.size(); j++)
+            {
+                Relation right = j == i ? move(next) : evaluate(j, nullptr);
+
+                Scheme scheme = ExternalRelation::joinScheme(joined->getScheme(), right.getSchemeNames());
+                auto output = make_unique<ExternalRelation>(rule.getName(), scheme, options.memoryLimit, options.spillDir);
+                ExternalRelation::join(*joined, right, *output);
+                joined = move(output);
+            }
+
+            return joined->project(rule.getHeadPredicate().getParamNames());
+        }
+
+        result = result.join(next, &pool);
+        measure("join " + to_string(i), result);
+    }
+
+    //Project the needed columns
+    Relation projected = result.project(rule.getHeadPredicate().getParamNames());
+    measure("project", projected);
+    return projected;
+}
+
+//Adds a rule's result to its relation, returns true if anything new was added
+bool Interpreter::addRuleResult(Relation result, ostream& out)
+{
+    //Rename to the original column
+    Relation& original = database.getRelation(result.getName());
+    int sizeBefore = original.size();
+    
+    //To prevent an invalid argument error
+    if (result.size() > 0) {
+        result = result.rename(original.getSchemeNames());
+
+        //Nothing to print or log, so no need to know which tuples were new
+        if (!tracing() && checkpoint == nullptr)
+        {
+            for (const Tuple& tuple : result)
+            {
+                original.addTuple(tuple);
+            }
+
+            return original.size() > sizeBefore;
+        }
+
+        Relation diff = result.diff(original);
+
+        //Only the new tuples need adding, no need to copy the relation
+        for (const Tuple& tuple : diff)
+        {
+            original.addTuple(tuple);
+        }
+
+        //If there was a change, make it known
+        if (original.size() > sizeBefore)
+        {
+            if (checkpoint != nullptr)
+            {
+                checkpoint->addTuples(diff);
+            }
+
+            OutputBuffer(out).addTuples(diff);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+Relation Interpreter::evaluatePredicate(Predicate predicate)
+{
+    int numResults;
+    return evaluatePredicate(predicate, numResults);
+}
+
+Relation Interpreter::evaluatePredicate(Predicate predicate, int& numResults)
+{
+    return evaluatePredicate(database.getRelation(predicate.getName()), predicate, numResults);
+}
+
+Relation Interpreter::evaluatePredicate(const Relation& relation, Predicate predicate, int& numResults, const Relation* joinWith)
+{
+    Query query(predicate.getParams());
+
+    //Only the matching tuples get copied out of the relation
+    Relation result = relation.select(predicate, joinWith);
+    
+    vector<int> projections;
+    vector<string> newNames;
+
+    //The variables, each kept at its first column
+    map<string, vector<int>> variables = query.getVariables();
+
+    int currIt = 0;
+    for (auto& variable : variables)
+    {
+        //Optimized: get the projection indexes
+        int position = query.getParameterNamePosition(variable.first);
+
+        //The positions need to be sorted for this to work
+        //If it needs to be sorted, find where to put it
+        if (currIt > 0 && position < projections.at(currIt - 1)) 
+        {
+            int index = currIt;
+            while (index > 0 && position < projections.at(index - 1))
+            {
+                index--;
+            }
+            projections.insert(projections.begin() + index, position);
+
+            //Optimized: get the rename mapping
+            newNames.insert(newNames.begin() + index, variable.first);
+        }
+        //Otherwise stick it on the end
+        else
+        {
+            projections.push_back(position);
+
+            //Optimized: get the rename mapping
+            newNames.push_back(variable.first);
+        }
+        
+
+        currIt++;
+    }
+
+    //Get the result size
+    numResults = result.size();
+
+    //Project the result
+    result = result.project(projections);
+
+    //Rename the result
+    result = result.rename(newNames);
+
+    return result;
+}
+
+//Throws unless the program has a scheme by the predicate's name with as many columns
+void Interpreter::checkScheme(const Predicate& predicate)
+{
+    for (Predicate& scheme : datalogProgram.getSchemes())
+    {
+        if (scheme.getName() != predicate.getName())
+        {
+            continue;
+        }
+
+        if (scheme.getParams().size() != predicate.getParams().size())
+        {
+            throw invalid_argument(predicate.toString() + " must have the same size as the scheme " + scheme.toString());
+        }
+        return;
+    }
+
+    throw invalid_argument("There is no scheme named " + predicate.getName());
+}
+
+Database Interpreter::insertFacts(const vector<Predicate>& facts)
+{
+    //All of them are checked first, so a bad one doesn't leave half the batch in
+    for (const Predicate& fact : facts)
+    {
+        checkScheme(fact);
+    }
+
+    Database delta;
+    for (const Predicate& fact : facts)
+    {
+        string name = fact.getName();
+
+        //Pruned, nothing asks about it
+        if (database.count(name) == 0)
+        {
+            continue;
+        }
+
+        Relation& relation = database.getRelation(name);
+        Tuple tuple(fact.getParamNames());
+        if (relation.addTuple(tuple))
+        {
+            addToDelta(delta, relation, tuple);
+        }
+
+        Predicate added = fact;
+        datalogProgram.addFact(added);
+    }
+
+    for (const SCC& scc : sccs)
+    {
+        propagate(scc, delta);
+    }
+
+    publish(delta, Database());
+
+    return delta;
+}
+
+//Semi-naive evaluation of one SCC. Every rule is evaluated once per body
+//predicate that has new tuples, with that predicate reading only the new
+//tuples. Whatever it derives is the delta for the next round
+void Interpreter::propagate(const SCC& scc, Database& delta)
+{
+    //The first round sees everything new so far, from the facts and earlier SCCs
+    Database round = delta;
+
+    while (!round.empty())
+    {
+        Database next;
+
+        for (const Rule& rule : scc)
+        {
+            vector<Predicate> body = rule.getBodyPredicates();
+            for (unsigned int i = 0; i < body.size(); i++)
+            {
+                auto changed = round.find(body.at(i).getName());
+                if (changed == round.end() || changed->second.size() == 0)
+                {
+                    continue;
+                }
+
+                Relation result = evaluateRuleBody(rule, i, &changed->second);
+                if (result.size() == 0)
+                {
+                    continue;
+                }
+
+                Relation& original = database.getRelation(rule.getName());
+                result = result.rename(original.getSchemeNames());
+
+                for (const Tuple& tuple : result)
+                {
+                    if (original.addTuple(tuple))
+                    {
+                        addToDelta(next, original, tuple);
+                        addToDelta(delta, original, tuple);
+                    }
+                }
+            }
+        }
+
+        round = next;
+    }
+}
+
+void Interpreter::runInsert(const vector<Predicate>& facts)
+{
+    Database delta = insertFacts(facts);
+
+    cout << '\n' << "Fact Insertion" << '\n';
+    for (auto& pair : delta)
+    {
+        cout << pair.first << ": " << pair.second.size() << " new" << '\n';
+    }
+
+    cout << '\n';
+    evaluateQueries();
+}
+
+Database Interpreter::retractFacts(const vector<Predicate>& facts)
+{
+    Database deleted;
+    for (const Predicate& fact : facts)
+    {
+        //Only given facts can be taken back, and only ones still in the database
+        if (database.count(fact.getName()) == 0 || !datalogProgram.removeFact(fact))
+        {
+            continue;
+        }
+
+        Relation& relation = database.getRelation(fact.getName());
+        Tuple tuple(fact.getParamNames());
+        if (relation.contains(tuple))
+        {
+            addToDelta(deleted, relation, tuple);
+        }
+    }
+
+    //Over-delete everything with a derivation that uses a deleted tuple,
+    //worked out against the database as it was
+    for (const SCC& scc : sccs)
+    {
+        overdelete(scc, deleted);
+    }
+
+    for (auto& pair : deleted)
+    {
+        Relation& relation = database.getRelation(pair.first);
+        for (const Tuple& tuple : pair.second)
+        {
+            relation.removeTuple(tuple);
+        }
+    }
+
+    //Put back what can still be derived, and whatever follows from that
+    Database restored = rederive(deleted);
+    for (auto& pair : restored)
+    {
+        Relation& relation = database.getRelation(pair.first);
+        for (const Tuple& tuple : pair.second)
+        {
+            relation.addTuple(tuple);
+        }
+    }
 
-        Scheme scheme(dpScheme.getParamNames());
-        Relation relation(name, scheme);
+    for (const SCC& scc : sccs)
+    {
+        propagate(scc, restored);
+    }
 
-        relations.insert(pair<string, Relation>(name,relation));
+    Database removed;
+    for (auto& pair : deleted)
+    {
+        Relation& relation = database.getRelation(pair.first);
+        for (const Tuple& tuple : pair.second)
+        {
+            if (!relation.contains(tuple))
+            {
+                addToDelta(removed, relation, tuple);
+            }
+        }
     }
 
-    database = Database(relations);
-}
+    publish(Database(), removed);
 
-void Interpreter::evaluateFacts()
-{
-    for (auto& fact : datalogProgram.getFacts()) {
-        string name = fact.getName();
-        Relation& relation = database.getRelation(name);
-        Tuple tuple(fact.getParamNames());
-        relation.addTuple(tuple);
-    }
+    return removed;
 }
 
-void Interpreter::evaluateRules()
+//Semi-naive like propagate, but collects the tuples in the database that
+//have a derivation using a deleted tuple instead of adding new ones
+void Interpreter::overdelete(const SCC& scc, Database& deleted)
 {
-    // Build the dependency graph.
-    Graph dependencyGraph = Interpreter::makeGraph(datalogProgram.getRules());
+    Database round = deleted;
 
-    cout << "Dependency Graph" << endl << dependencyGraph.toString() << endl;
+    while (!round.empty())
+    {
+        Database next;
 
-    //Build the reverse dependency graph.
-    Graph reverseGraph = Interpreter::makeGraph(datalogProgram.getRules(), true);
+        for (const Rule& rule : scc)
+        {
+            vector<Predicate> body = rule.getBodyPredicates();
+            for (unsigned int i = 0; i < body.size(); i++)
+            {
+                auto changed = round.find(body.at(i).getName());
+                if (changed == round.end() || changed->second.size() == 0)
+                {
+                    continue;
+                }
 
-    //Run DFS-Forest on the reverse dependency graph.
-    stack<int> postOrders = Interpreter::dfsForest(reverseGraph);
+                Relation result = evaluateRuleBody(rule, i, &changed->second);
+                if (result.size() == 0)
+                {
+                    continue;
+                }
 
-    //Find the strongly connected components (SCCs).
-    vector<SCC> sccs = findSCC(postOrders, dependencyGraph);
-    
-    //Evaluate the rules in each component.
-    evaluateRulesWithSCC(sccs);
+                Relation& original = database.getRelation(rule.getName());
+                result = result.rename(original.getSchemeNames());
+
+                for (const Tuple& tuple : result)
+                {
+                    auto gone = deleted.find(rule.getName());
+                    bool isDeleted = gone != deleted.end() && gone->second.contains(tuple);
+
+                    if (original.contains(tuple) && !isDeleted)
+                    {
+                        addToDelta(next, original, tuple);
+                        addToDelta(deleted, original, tuple);
+                    }
+                }
+            }
+        }
+
+        round = next;
+    }
 }
 
-void Interpreter::evaluateRulesWithSCC(vector<SCC> sccs)
+//The over-deleted tuples that are still given as facts, or that some rule
+//derives in one step from what is left. Each rule is evaluated seeded with
+//its head's deleted tuples, so the body only gets probed for those
+Database Interpreter::rederive(const Database& deleted)
 {
-    cout << "Rule Evaluation" << endl;
+    Database restored;
+
+    for (Predicate& fact : datalogProgram.getFacts())
+    {
+        auto gone = deleted.find(fact.getName());
+        Tuple tuple(fact.getParamNames());
+        if (gone != deleted.end() && gone->second.contains(tuple))
+        {
+            addToDelta(restored, gone->second, tuple);
+        }
+    }
 
-    for (SCC scc : sccs)
+    for (const SCC& scc : sccs)
     {
-        cout << scc.toString() << endl;
-        int i = 0;
-        do
+        for (const Rule& rule : scc)
         {
-            //Only evaluate scc that aren't rule dependent once (have one rule not itself)
-            if (!scc.isRuleDependent() && i > 0)
+            auto gone = deleted.find(rule.getName());
+            if (gone == deleted.end() || gone->second.size() == 0)
+            {
+                continue;
+            }
+
+            int numResults;
+            Relation seed = evaluatePredicate(gone->second, rule.getHeadPredicate(), numResults);
+            if (seed.size() == 0)
             {
-                break;
+                continue;
             }
 
-            i++;
-        } while (evaluateRule(scc));
+            Relation result = evaluateRuleBody(rule, -1, nullptr, &seed);
+            if (result.size() == 0)
+            {
+                continue;
+            }
 
-       cout << i << " passes: " << scc.getName() << endl;
+            result = result.rename(gone->second.getSchemeNames());
+            for (const Tuple& tuple : result)
+            {
+                if (gone->second.contains(tuple))
+                {
+                    addToDelta(restored, gone->second, tuple);
+                }
+            }
+        }
     }
 
-    cout << endl;
+    return restored;
 }
 
-void Interpreter::evaluateRulesOld()
+void Interpreter::runRetract(const vector<Predicate>& facts)
 {
-    cout << "Rule Evaluation" << endl;
-    int i = 0;
-    do
+    Database removed = retractFacts(facts);
+
+    cout << '\n' << "Fact Retraction" << '\n';
+    for (auto& pair : removed)
     {
-       i++;
-    } while (evaluateRule(datalogProgram.getRules()));
+        cout << pair.first << ": " << pair.second.size() << " removed" << '\n';
+    }
 
-    cout << endl << "Schemes populated after " << i << " passes through the Rules." << endl << endl;
+    cout << '\n';
+    evaluateQueries();
 }
 
-bool Interpreter::evaluateRule(vector<Rule> rules)
+Database Interpreter::addRule(Rule rule)
 {
-    bool changed = false;
-    for (Rule& rule : rules)
+    //Checked before anything changes, a bad rule leaves the program as it was
+    vector<Predicate> predicates = rule.getBodyPredicates();
+    predicates.push_back(rule.getHeadPredicate());
+    for (Predicate& predicate : predicates)
     {
-        cout << rule.toString() << endl;
+        if (database.count(predicate.getName()) == 0)
+        {
+            throw invalid_argument("There is no scheme named " + predicate.getName());
+        }
 
-        vector<Relation> immediateResults;
-        //Get the immediate results
-        for (Predicate& predicate : rule.getBodyPredicates())
+        checkScheme(predicate);
+    }
+
+    set<string> bodyVariables;
+    for (Predicate& predicate : rule.getBodyPredicates())
+    {
+        for (Parameter& param : predicate.getParams())
         {
-            Relation result = evaluatePredicate(predicate);
-            immediateResults.push_back(result);
+            if (param.isId)
+            {
+                bodyVariables.insert(param.value);
+            }
         }
+    }
 
-        //Join them
-        Relation result = immediateResults.at(0);
-        result.setName(rule.getName());
-        for (unsigned int i = 1; i < immediateResults.size(); i++)
+    for (Parameter& param : rule.getHeadPredicate().getParams())
+    {
+        if (param.isId && bodyVariables.count(param.value) == 0)
         {
-            result = result.join(immediateResults.at(i));
+            throw invalid_argument("The head variable " + param.value + " isn't in the body of " + rule.toString());
         }
+    }
 
-        //Project the needed columns
-        result = result.project(rule.getHeadPredicate().getParamNames());
+    //Put back if evaluating the rule fails, along with the relations it changed
+    DatalogProgram oldProgram = datalogProgram;
+    vector<SCC> oldSccs = sccs;
+    map<string, Relation> before;
+    Database delta;
 
-        //Rename to the original column
-        Relation& original = database.getRelation(result.getName());
-        int sizeBefore = original.size();
-        
-        //To prevent an invalid argument error
-        if (result.size() > 0) {
-            result = result.rename(original.getSchemeNames());
+    try
+    {
+        datalogProgram.addRule(rule);
+
+        vector<Rule> rules = datalogProgram.getRules();
+        Graph dependencyGraph = Interpreter::makeGraph(rules);
+        Graph reverseGraph = Interpreter::makeGraph(rules, true);
+        sccs = findSCC(Interpreter::dfsForest(reverseGraph), dependencyGraph);
+
+        //Run the new rule's SCC to a fixpoint, what it adds seeds the SCCs after it
+        int id = rules.size() - 1;
+        for (const SCC& scc : sccs)
+        {
+            vector<int> ids = scc.getIds();
+            if (find(ids.begin(), ids.end(), id) == ids.end())
+            {
+                continue;
+            }
+
+            for (const Rule& sccRule : scc)
+            {
+                before.emplace(sccRule.getName(), database.getRelation(sccRule.getName()));
+            }
+
+            //The trace isn't wanted here
+            stringstream ignored;
+            evaluateSCC(scc, ignored);
 
-            Relation diff = result.diff(original);
+            for (auto& pair : before)
+            {
+                Relation& relation = database.getRelation(pair.first);
+                Relation added = relation.diff(pair.second);
+                for (const Tuple& tuple : added)
+                {
+                    addToDelta(delta, relation, tuple);
+                }
+            }
+        }
 
-            original = original.Union(result);
+        for (const SCC& scc : sccs)
+        {
+            propagate(scc, delta);
+        }
+    }
+    catch (...)
+    {
+        datalogProgram = oldProgram;
+        sccs = oldSccs;
+        for (auto& pair : before)
+        {
+            database.getRelation(pair.first) = pair.second;
+        }
 
-            //If there was a change, make it known
-            if (original.size() > sizeBefore)
+        //Everything propagated so far is in the delta
+        for (auto& pair : delta)
+        {
+            Relation& relation = database.getRelation(pair.first);
+            for (const Tuple& tuple : pair.second)
             {
-                changed = true;
-                cout << diff.toString() << endl;
+                relation.removeTuple(tuple);
             }
         }
+        throw;
     }
 
-    return changed;
+    publish(delta, Database());
+
+    return delta;
 }
 
-Relation Interpreter::evaluatePredicate(Predicate predicate)
+//Safe to call from any thread, it only reads the snapshot
+string Interpreter::answerQuery(const Predicate& query, const Snapshot& snapshot)
 {
-    int numResults;
-    return evaluatePredicate(predicate, numResults);
+    auto relation = snapshot.relations.find(query.getName());
+    if (relation == snapshot.relations.end())
+    {
+        throw invalid_argument("There is no scheme named " + query.getName());
+    }
+
+    QueryCursor cursor(relation->second, query);
+
+    stringstream text;
+    {
+        OutputBuffer out(text);
+        evaluateQuery(cursor, query, out);
+    }
+
+    return text.str();
 }
 
-Relation Interpreter::evaluatePredicate(Predicate predicate, int& numResults)
+string Interpreter::answerQuery(const Predicate& query, const DatabaseFile& file)
 {
-    Relation& relation = database.getRelation(predicate.getName());
+    return evaluateQuery(file.lookup(query), query, query);
+}
 
-    Query query(predicate.getParams());
-    Relation result = relation;
-    
-    vector<int> projections;
-    vector<string> newNames;
-    
-    //Select all the constant values
-    vector<int> constants = query.getConstants();
-    for (auto& index : constants)
+void Interpreter::saveDatabase(const string& path)
+{
+    DatabaseFile::save(database, path);
+}
+
+void Interpreter::runFromFile(const DatabaseFile& file)
+{
+    cout << "Query Evaluation" << '\n';
+
+    OutputBuffer out(cout);
+    vector<Predicate> dbQueries = datalogProgram.getQueries();
+    for (unsigned int i = 0; i < dbQueries.size(); i++)
     {
-        result = result.select(index, query.at(index).value);
+        evaluateQuery(file.lookup(dbQueries.at(i)), dbQueries.at(i), queries.at(i), out);
     }
+}
 
-    //Select all the variable values
-    map<string, vector<int>> variables = query.getVariables();
+void Interpreter::enableSnapshots()
+{
+    versions.publish(database, Database(), Database());
+    versioned = true;
+}
 
-    int currIt = 0;
-    for (auto& variable : variables)
+shared_ptr<const Snapshot> Interpreter::snapshot() const
+{
+    return versions.read();
+}
+
+void Interpreter::publish(const Database& added, const Database& removed)
+{
+    if (!versioned)
     {
-        result = result.select(variable.second);
+        return;
+    }
 
-        //Optimized: get the projection indexes
-        int position = query.getParameterNamePosition(variable.first);
+    versions.publish(database, added, removed);
+}
 
-        //The positions need to be sorted for this to work
-        //If it needs to be sorted, find where to put it
-        if (currIt > 0 && position < projections.at(currIt - 1)) 
-        {
-            int index = currIt;
-            while (index > 0 && position < projections.at(index - 1))
-            {
-                index--;
-            }
-            projections.insert(projections.begin() + index, position);
+void Interpreter::addToDelta(Database& delta, const Relation& relation, const Tuple& tuple)
+{
+    delta.emplace(relation.getName(), Relation(relation.getName(), relation.getSchemeNames()));
+    delta.getRelation(relation.getName()).addTuple(tuple);
+}
 
-            //Optimized: get the rename mapping
-            newNames.insert(newNames.begin() + index, variable.first);
-        }
-        //Otherwise stick it on the end
-        else
-        {
-            projections.push_back(position);
+//Queries only read the database, so they are answered on the pool and the
+//answers printed in query order afterwards
+void Interpreter::evaluateQueries()
+{
+    cout << "Query Evaluation" << '\n';
 
-            //Optimized: get the rename mapping
-            newNames.push_back(variable.first);
+    vector<Predicate> dbQueries = datalogProgram.getQueries();
+
+    //With nothing to run them on, they go straight to the output
+    if (pool.size() <= 1)
+    {
+        OutputBuffer out(cout);
+        for (unsigned int i = 0; i < dbQueries.size(); i++)
+        {
+            evaluateQuery(dbQueries.at(i), queries.at(i), out);
         }
-        
 
-        currIt++;
+        return;
     }
 
-    //Get the result size
-    numResults = result.size();
+    vector<string> answers(dbQueries.size());
 
-    //Project the result
-    result = result.project(projections);
+    pool.run(dbQueries.size(), [&](int i) {
+        answers.at(i) = evaluateQuery(dbQueries.at(i), queries.at(i));
+    });
 
-    //Rename the result
-    result = result.rename(newNames);
+    for (string& answer : answers)
+    {
+        cout << answer;
+    }
+}
 
-    return result;
+void Interpreter::evaluateQuery(Predicate dbQuery, const Predicate& asked, OutputBuffer& out)
+{
+    auto it = frozen.find(dbQuery.getName());
+    if (it != frozen.end() && it->second != nullptr)
+    {
+        evaluateQuery(it->second->select(dbQuery), dbQuery, asked, out);
+        return;
+    }
+
+    evaluateQuery(database.getRelation(dbQuery.getName()), dbQuery, asked, out);
 }
 
-void Interpreter::evaluateQueries()
+void Interpreter::evaluateQuery(const Relation& relation, Predicate dbQuery, const Predicate& asked, OutputBuffer& out)
+{
+    QueryCursor cursor(relation, dbQuery);
+    evaluateQuery(cursor, asked, out);
+}
+
+void Interpreter::evaluateQuery(QueryCursor& cursor, const Predicate& asked, OutputBuffer& out)
 {
-    cout << "Query Evaluation" << endl;
-    for (auto& dbQuery : datalogProgram.getQueries())
+    //The answers are counted first, then walked again to print them
+    int numResults = cursor.count();
+
+    //Get the result string
+    string resultString = numResults > 0 ? "Yes(" + to_string(numResults) + ")" : "No";
+
+    //Display the results of the query
+    out << asked.toString() << "? " << resultString << '\n';
+    //A query of nothing but constants has no columns to list
+    if (options.verbosity != Verbosity::Counts && !cursor.getScheme().empty())
     {
-        int numResults;
-        Relation result = evaluatePredicate(dbQuery, numResults);
+        out.addTuples(cursor);
+    }
+}
+
+QueryCursor Interpreter::openQuery(const Predicate& query)
+{
+    auto it = frozen.find(query.getName());
+    if (it != frozen.end() && it->second != nullptr)
+    {
+        return QueryCursor(make_shared<const Relation>(it->second->select(query)), query);
+    }
 
-        //Get the result string
-        string resultString = numResults > 0 ? "Yes(" + to_string(numResults) + ")" : "No";
+    return QueryCursor(database.getRelation(query.getName()), query);
+}
 
-        //Display the results of the query
-        cout << dbQuery.toString() << "? " << resultString << endl;
+string Interpreter::evaluateQuery(Predicate dbQuery, const Predicate& asked)
+{
+    stringstream text;
+    {
+        OutputBuffer out(text);
+        evaluateQuery(dbQuery, asked, out);
+    }
 
-        if (result.size() > 0) {
-            cout << result.toString() << endl;
-        }
+    return text.str();
+}
+
+string Interpreter::evaluateQuery(const Relation& relation, Predicate dbQuery, const Predicate& asked)
+{
+    stringstream text;
+    {
+        OutputBuffer out(text);
+        evaluateQuery(relation, dbQuery, asked, out);
     }
+
+    return text.str();
 }
 
 Graph Interpreter::makeGraph(const vector<Rule>& rules, bool reverse)
@@ -403,4 +1585,88 @@ vector<SCC> Interpreter::findSCC(stack<int> postOrders, Graph& graph)
     }
 
     return sccs;
+}
+
+//For each SCC, the earlier SCCs it has to wait for. That is the ones it reads
+//from, plus the ones that write the same relation so the writes stay in order
+vector<set<int>> Interpreter::sccDependencies(const vector<SCC>& sccs, Graph& graph)
+{
+    map<int, int> sccOfRule;
+    for (unsigned int i = 0; i < sccs.size(); i++)
+    {
+        for (int id : sccs.at(i).getIds())
+        {
+            sccOfRule[id] = i;
+        }
+    }
+
+    vector<set<int>> dependencies(sccs.size());
+    map<string, int> lastWriter;
+
+    for (unsigned int i = 0; i < sccs.size(); i++)
+    {
+        for (int id : sccs.at(i).getIds())
+        {
+            for (int to : graph.at(id))
+            {
+                if (sccOfRule.at(to) != (int)i)
+                {
+                    dependencies.at(i).insert(sccOfRule.at(to));
+                }
+            }
+        }
+
+        for (const Rule& rule : sccs.at(i))
+        {
+            auto writer = lastWriter.find(rule.getName());
+            if (writer != lastWriter.end() && writer->second != (int)i)
+            {
+                dependencies.at(i).insert(writer->second);
+            }
+        }
+
+        for (const Rule& rule : sccs.at(i))
+        {
+            lastWriter[rule.getName()] = i;
+        }
+    }
+
+    return dependencies;
+}
+
+//The rules whose head some query asks about, and every rule those depend on
+set<int> Interpreter::reachableRules(Graph& graph, const vector<Rule>& rules, const vector<Predicate>& queries)
+{
+    set<string> asked;
+    for (const Predicate& query : queries)
+    {
+        asked.insert(query.getName());
+    }
+
+    set<int> reached;
+    vector<int> work;
+    for (unsigned int id = 0; id < rules.size(); id++)
+    {
+        if (asked.count(rules.at(id).getName()) > 0)
+        {
+            reached.insert(id);
+            work.push_back(id);
+        }
+    }
+
+    while (!work.empty())
+    {
+        int id = work.back();
+        work.pop_back();
+
+        for (int to : graph.at(id))
+        {
+            if (reached.insert(to).second)
+            {
+                work.push_back(to);
+            }
+        }
+    }
+
+    return reached;
 }
\ No newline at end of file
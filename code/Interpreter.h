@@ -5,7 +5,22 @@
 #include "Graph.h"
 #include "Node.h"
 #include "SCC.h"
+#include "Options.h"
+#include "ThreadPool.h"
+#include "VersionedDatabase.h"
+#include "DatabaseFile.h"
+#include "Checkpoint.h"
+#include "ResultCache.h"
+#include "FrozenRelation.h"
+#include "MemoryReport.h"
+#include "OutputBuffer.h"
+#include "QueryCursor.h"
 #include <stack>
+#include <set>
+#include <ostream>
+#include <map>
+#include <atomic>
+#include <memory>
 #include <vector>
 
 using namespace std;
@@ -14,27 +29,117 @@ class Interpreter
 {
 private:
     DatalogProgram datalogProgram;
+    vector<Predicate> queries;
+    vector<SCC> sccs;
     Database database;
+    Options options;
+    ThreadPool pool;
+
+    VersionedDatabase versions;
+    bool versioned;
+
+    //How many SCCs still have to run that use each relation
+    map<string, atomic<int>> remainingUsers;
+
+    //Only set while the rules are being evaluated with --checkpoint
+    unique_ptr<Checkpoint> checkpoint;
+    Progress resumed;
+
+    //SCC results from earlier runs, with --cache
+    unique_ptr<ResultCache> cache;
+
+    //The base relations, with --columnar or --trie. Their entries in the
+    //database stay empty
+    map<string, unique_ptr<FrozenRelation>> frozen;
+
+    //With --memory-report
+    unique_ptr<MemoryReport> memory;
 
     void evaluateSchemes();
     void evaluateFacts();
     void evaluateRulesOld();
     void evaluateRules();
-    void evaluateRulesWithSCC(vector<SCC> sccs);
+    void freezeBaseRelations();
+    void measure(const SCC& scc);
+    void measureRelations();
+    vector<SCC> pruneSCCs(const vector<SCC>& sccs, Graph& dependencyGraph);
+    void evaluateRulesWithSCC(vector<SCC> sccs, Graph& dependencyGraph);
+    void startCheckpoint();
+    bool tracing() const;
+    void evaluateSCC(SCC scc, ostream& out, int index = -1);
+    string cacheKey(const SCC& scc);
+    vector<const Relation*> sccOutputs(const SCC& scc);
+    void countRelationUsers(const vector<SCC>& sccs);
+    void releaseRelations(const SCC& scc);
+    static set<string> relationsUsed(const SCC& scc);
+    void evaluateSCCsConcurrently(const vector<SCC>& sccs, Graph& dependencyGraph);
     void evaluateQueries();
+    string evaluateQuery(Predicate dbQuery, const Predicate& asked);
+    string evaluateQuery(const Relation& relation, Predicate dbQuery, const Predicate& asked);
+    void evaluateQuery(Predicate dbQuery, const Predicate& asked, OutputBuffer& out);
+    void evaluateQuery(const Relation& relation, Predicate dbQuery, const Predicate& asked, OutputBuffer& out);
+    void evaluateQuery(QueryCursor& cursor, const Predicate& asked, OutputBuffer& out);
 
-    bool evaluateRule(vector<Rule> rules);
+    bool evaluateRule(vector<Rule> rules, ostream& out = cout);
+    bool evaluateRuleParallel(const vector<Rule>& rules, ostream& out);
+    Relation evaluateRuleBody(const Rule& rule, int deltaIndex = -1, const Relation* delta = nullptr,
+                              const Relation* seed = nullptr);
+    bool addRuleResult(Relation result, ostream& out);
 
+    Relation evaluatePredicate(const Relation& relation, Predicate predicate, int& numResults, const Relation* joinWith = nullptr);
     Relation evaluatePredicate(Predicate predicate, int& numResults);
     Relation evaluatePredicate(Predicate predicate);
+
+    void propagate(const SCC& scc, Database& delta);
+    void publish(const Database& added, const Database& removed);
+    void overdelete(const SCC& scc, Database& deleted);
+    Database rederive(const Database& deleted);
+    void checkScheme(const Predicate& predicate);
+    static void addToDelta(Database& delta, const Relation& relation, const Tuple& tuple);
 public:
-    Interpreter(DatalogProgram datalogProgram);
+    Interpreter(DatalogProgram datalogProgram, Options options = Options());
 
     void run();
 
+    //Adds facts to the evaluated database and derives only their
+    //consequences, seeding semi-naive evaluation with the new tuples.
+    //Returns the tuples that were new, by relation
+    Database insertFacts(const vector<Predicate>& facts);
+    void runInsert(const vector<Predicate>& facts);
+
+    //Takes facts back with delete and rederive: everything derived from them
+    //is deleted, then the tuples that still have another derivation come back.
+    //Returns the tuples that are gone, by relation
+    Database retractFacts(const vector<Predicate>& facts);
+    void runRetract(const vector<Predicate>& facts);
+
+    //Adds a rule to the evaluated program and derives what it adds.
+    //Returns the tuples that were new, by relation
+    Database addRule(Rule rule);
+
+    //Starts publishing a snapshot of the database after every update, so
+    //readers on other threads can query while the updates go on
+    void enableSnapshots();
+    shared_ptr<const Snapshot> snapshot() const;
+
+    //The query's answer, formatted the way evaluateQueries prints it
+    string answerQuery(const Predicate& query, const Snapshot& snapshot);
+    string answerQuery(const Predicate& query, const DatabaseFile& file);
+
+    //The answers to a query one at a time, in order, without collecting
+    //them. The database mustn't change while the cursor is in use
+    QueryCursor openQuery(const Predicate& query);
+
+    void saveDatabase(const string& path);
+
+    //Answers the program's queries from a saved database instead of evaluating
+    void runFromFile(const DatabaseFile& file);
+
     static Graph makeGraph(const vector<Rule>& rules, bool reverse = false);
     static stack<int> dfsForest(Graph graph);
     static stack<int> dfs(int index, Graph& graph);
 
     vector<SCC> findSCC(stack<int> postOrders, Graph& graph);
+    static set<int> reachableRules(Graph& graph, const vector<Rule>& rules, const vector<Predicate>& queries);
+    static vector<set<int>> sccDependencies(const vector<SCC>& sccs, Graph& graph);
 };
\ No newline at end of file
@@ -0,0 +1,84 @@
+#include "LayeredRelation.h"
+#include <algorithm>
+
+using namespace std;
+
+size_t LayeredRelation::layerSize(const Layer& layer)
+{
+    return layer.first->size() + layer.second->size();
+}
+
+//One layer that does what the two do one after the other: everything either
+//removes is removed, and what the older adds stays unless the newer removes it
+LayeredRelation::Layer LayeredRelation::merge(const Layer& older, const Layer& newer)
+{
+    Relation added = *newer.first;
+    for (const Tuple& tuple : *older.first)
+    {
+        if (!newer.second->contains(tuple))
+        {
+            added.addTuple(tuple);
+        }
+    }
+
+    Relation removed = *older.second;
+    for (const Tuple& tuple : *newer.second)
+    {
+        removed.addTuple(tuple);
+    }
+
+    return Layer(make_shared<const Relation>(move(added)), make_shared<const Relation>(move(removed)));
+}
+
+//Applies the only layer to a copy of the base
+void LayeredRelation::fold()
+{
+    Relation folded = *base;
+    for (const Tuple& tuple : *layers.front().second)
+    {
+        folded.removeTuple(tuple);
+    }
+    for (const Tuple& tuple : *layers.front().first)
+    {
+        folded.addTuple(tuple);
+    }
+
+    base = make_shared<const Relation>(move(folded));
+    layers.clear();
+}
+
+LayeredRelation LayeredRelation::withChanges(const Relation* added, const Relation* removed) const
+{
+    bool adds = added != nullptr && added->size() > 0;
+    bool removes = removed != nullptr && removed->size() > 0;
+    if (!adds && !removes)
+    {
+        return *this;
+    }
+
+    Relation empty(base->getName(), base->getSchemeNames());
+    LayeredRelation next = *this;
+    next.layers.push_back(Layer(make_shared<const Relation>(adds ? *added : empty),
+                                make_shared<const Relation>(removes ? *removed : empty)));
+
+    while (next.layers.size() > 1 && layerSize(next.layers.end()[-2]) <= 2 * layerSize(next.layers.back()))
+    {
+        Layer merged = merge(next.layers.end()[-2], next.layers.back());
+        next.layers.pop_back();
+        next.layers.back() = merged;
+    }
+
+    //The oldest layer is the biggest, the rest together are smaller than it
+    if (layerSize(next.layers.front()) >= max(FOLD_MIN_TUPLES, (size_t)base->size() / 2))
+    {
+        while (next.layers.size() > 1)
+        {
+            Layer merged = merge(next.layers.end()[-2], next.layers.back());
+            next.layers.pop_back();
+            next.layers.back() = merged;
+        }
+        next.fold();
+    }
+
+    return next;
+}
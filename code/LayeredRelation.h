@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <utility>
+#include "Relation.h"
+
+using namespace std;
+
+//A read only relation kept as a shared base plus layers of changes on top,
+//so a new version costs about as much as what changed instead of a copy of
+//the whole relation. Each layer takes its removed tuples out of what's under
+//it and then puts its added ones in; the newest layer to mention a tuple
+//decides whether it's there.
+//
+//Layers get merged so each is at least twice the size of the one after it,
+//keeping only a few of them, and the oldest gets folded into a new base once
+//it's a good part of the base's size
+class LayeredRelation
+{
+    friend class QueryCursor;
+
+private:
+    typedef pair<shared_ptr<const Relation>, shared_ptr<const Relation>> Layer;
+
+    shared_ptr<const Relation> base;
+
+    //Added then removed tuples of each layer, oldest first
+    vector<Layer> layers;
+
+    static constexpr size_t FOLD_MIN_TUPLES = 1024;
+
+    static size_t layerSize(const Layer& layer);
+    static Layer merge(const Layer& older, const Layer& newer);
+    void fold();
+
+public:
+    LayeredRelation(shared_ptr<const Relation> base) : base(base) {}
+
+    //Another version with the changes on top, sharing this one's storage.
+    //Either can be null
+    LayeredRelation withChanges(const Relation* added, const Relation* removed) const;
+
+    vector<string> getSchemeNames() const
+    {
+        return base->getSchemeNames();
+    }
+};
@@ -0,0 +1,307 @@
+#include "MagicSets.h"
+#include <vector>
+#include <string>
+#include <set>
+#include <map>
+
+using namespace std;
+
+MagicSets::MagicSets(DatalogProgram program) : program(program)
+{
+    for (Predicate& scheme : program.getSchemes())
+    {
+        schemes[scheme.getName()] = scheme;
+    }
+
+    for (Rule& rule : program.getRules())
+    {
+        rulesByHead[rule.getName()].push_back(rule);
+    }
+}
+
+DatalogProgram MagicSets::rewrite()
+{
+    result = DatalogProgram();
+
+    for (const string& value : program.getDomain())
+    {
+        Parameter domain(value, false);
+        result.addDomain(domain);
+    }
+
+    for (Predicate& scheme : program.getSchemes())
+    {
+        result.addScheme(scheme);
+    }
+
+    for (Predicate& fact : program.getFacts())
+    {
+        result.addFact(fact);
+    }
+
+    //Seed the magic relations with the query constants
+    for (Predicate& query : program.getQueries())
+    {
+        string queryAdornment = adorn(query, set<string>(), true);
+
+        if (!isDerived(query.getName()) || queryAdornment.find('b') == string::npos)
+        {
+            if (isDerived(query.getName()))
+            {
+                full.insert(query.getName());
+            }
+
+            result.addQuerie(query);
+            continue;
+        }
+
+        require(query.getName(), queryAdornment);
+
+        Predicate seed(magicName(query.getName(), queryAdornment));
+        seed.addParams(boundParams(query, queryAdornment));
+        result.addFact(seed);
+
+        Predicate adornedQuery(adornedName(query.getName(), queryAdornment));
+        adornedQuery.addParams(query.getParams());
+        result.addQuerie(adornedQuery);
+    }
+
+    while (!pending.empty())
+    {
+        pair<string, string> next = pending.front();
+        pending.pop();
+
+        rewriteRules(next.first, next.second);
+    }
+
+    addFullRules();
+
+    return result;
+}
+
+bool MagicSets::isDerived(const string& name) const
+{
+    return rulesByHead.count(name) > 0;
+}
+
+//'b' for every column that is a bound variable (or a constant, for queries),
+//'f' for the rest
+string MagicSets::adorn(const Predicate& predicate, const set<string>& bound, bool constantsBound)
+{
+    string result;
+
+    for (const Parameter& param : predicate.getParams())
+    {
+        bool isBound = param.isId ? bound.count(param.value) > 0 : constantsBound;
+        result += isBound ? 'b' : 'f';
+    }
+
+    return result;
+}
+
+string MagicSets::adornedName(const string& name, const string& adornment)
+{
+    return name + "_" + adornment;
+}
+
+string MagicSets::magicName(const string& name, const string& adornment)
+{
+    return "magic_" + name + "_" + adornment;
+}
+
+vector<Parameter> MagicSets::boundParams(const Predicate& predicate, const string& adornment)
+{
+    vector<Parameter> params = predicate.getParams();
+    vector<Parameter> result;
+
+    for (unsigned int i = 0; i < params.size(); i++)
+    {
+        if (adornment.at(i) == 'b')
+        {
+            result.push_back(params.at(i));
+        }
+    }
+
+    return result;
+}
+
+//Queues an adorned predicate and adds the schemes for it and its magic relation
+void MagicSets::require(const string& name, const string& adornment)
+{
+    string adorned = adornedName(name, adornment);
+    if (this->adorned.count(adorned) > 0)
+    {
+        return;
+    }
+
+    this->adorned.insert(adorned);
+    pending.push(make_pair(name, adornment));
+
+    Predicate& scheme = schemes.at(name);
+
+    Predicate adornedScheme(adorned);
+    adornedScheme.addParams(scheme.getParams());
+    result.addScheme(adornedScheme);
+
+    Predicate magicScheme(magicName(name, adornment));
+    magicScheme.addParams(boundParams(scheme, adornment));
+    result.addScheme(magicScheme);
+}
+
+//Sideways information passing: the bindings for a body predicate are the
+//bound head columns plus everything the predicates before it bind. The body
+//is reordered so the predicate with the most bound columns goes next.
+//Constants in rule bodies are left free, rule heads can't hold them
+void MagicSets::rewriteRules(const string& name, const string& adornment)
+{
+    Predicate magicHead(magicName(name, adornment));
+    Predicate& scheme = schemes.at(name);
+
+    for (Rule& rule : rulesByHead.at(name))
+    {
+        Predicate head = rule.getHeadPredicate();
+
+        Predicate guard(magicHead.getName());
+        guard.addParams(boundParams(head, adornment));
+
+        set<string> bound;
+        for (Parameter& param : guard.getParams())
+        {
+            bound.insert(param.value);
+        }
+
+        vector<Predicate> body;
+        body.push_back(guard);
+
+        for (Predicate& predicate : orderBody(rule.getBodyPredicates(), bound))
+        {
+            Predicate rewritten = predicate;
+
+            if (isDerived(predicate.getName()))
+            {
+                string bodyAdornment = adorn(predicate, bound);
+
+                if (bodyAdornment.find('b') == string::npos)
+                {
+                    full.insert(predicate.getName());
+                }
+                else
+                {
+                    require(predicate.getName(), bodyAdornment);
+
+                    //Pass the bindings on to the body predicate's magic relation
+                    Predicate magicRuleHead(magicName(predicate.getName(), bodyAdornment));
+                    magicRuleHead.addParams(boundParams(predicate, bodyAdornment));
+                    Rule magicRule(magicRuleHead);
+                    magicRule.addPredicates(body);
+                    result.addRule(magicRule);
+
+                    rewritten = Predicate(adornedName(predicate.getName(), bodyAdornment));
+                    rewritten.addParams(predicate.getParams());
+                }
+            }
+
+            body.push_back(rewritten);
+
+            for (Parameter& param : predicate.getParams())
+            {
+                if (param.isId)
+                {
+                    bound.insert(param.value);
+                }
+            }
+        }
+
+        Predicate adornedHead(adornedName(name, adornment));
+        adornedHead.addParams(head.getParams());
+        Rule adornedRule(adornedHead);
+        adornedRule.addPredicates(body);
+        result.addRule(adornedRule);
+    }
+
+    //Facts given for a derived predicate still count, including ones
+    //inserted after the rewrite, so this is there even if it has none yet
+    Predicate adornedHead(adornedName(name, adornment));
+    adornedHead.addParams(scheme.getParams());
+
+    Predicate guard(magicHead.getName());
+    guard.addParams(boundParams(scheme, adornment));
+
+    Rule factRule(adornedHead);
+    factRule.addPredicate(guard);
+    factRule.addPredicate(scheme);
+    result.addRule(factRule);
+}
+
+vector<Predicate> MagicSets::orderBody(vector<Predicate> body, set<string> bound)
+{
+    vector<Predicate> ordered;
+
+    while (!body.empty())
+    {
+        int best = 0;
+        int bestCount = -1;
+
+        for (unsigned int i = 0; i < body.size(); i++)
+        {
+            int count = 0;
+            for (Parameter& param : body.at(i).getParams())
+            {
+                if (param.isId && bound.count(param.value) > 0)
+                {
+                    count++;
+                }
+            }
+
+            if (count > bestCount)
+            {
+                best = i;
+                bestCount = count;
+            }
+        }
+
+        for (Parameter& param : body.at(best).getParams())
+        {
+            if (param.isId)
+            {
+                bound.insert(param.value);
+            }
+        }
+
+        ordered.push_back(body.at(best));
+        body.erase(body.begin() + best);
+    }
+
+    return ordered;
+}
+
+//Predicates needed with nothing bound are evaluated in full, along with
+//everything they depend on
+void MagicSets::addFullRules()
+{
+    vector<string> work(full.begin(), full.end());
+    while (!work.empty())
+    {
+        string name = work.back();
+        work.pop_back();
+
+        for (Rule& rule : rulesByHead.at(name))
+        {
+            for (Predicate& predicate : rule.getBodyPredicates())
+            {
+                if (isDerived(predicate.getName()) && full.insert(predicate.getName()).second)
+                {
+                    work.push_back(predicate.getName());
+                }
+            }
+        }
+    }
+
+    for (Rule& rule : program.getRules())
+    {
+        if (full.count(rule.getName()) > 0)
+        {
+            result.addRule(rule);
+        }
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <set>
+#include <map>
+#include <queue>
+#include "DatalogProgram.h"
+#include "Predicate.h"
+#include "Rule.h"
+
+using namespace std;
+
+//Rewrites a program so evaluation only derives tuples the queries can use.
+//Each derived predicate gets a copy per binding pattern ("p_bf" is p with its
+//first column bound) guarded by a magic relation ("magic_p_bf") holding the
+//bindings that are actually asked for. The seeds come from the query constants
+class MagicSets
+{
+private:
+    DatalogProgram program;
+    DatalogProgram result;
+
+    map<string, Predicate> schemes;
+    map<string, vector<Rule>> rulesByHead;
+
+    //Adorned predicates that have been queued, and predicates that are
+    //needed with nothing bound so they keep their original rules
+    set<string> adorned;
+    queue<pair<string, string>> pending;
+    set<string> full;
+
+    bool isDerived(const string& name) const;
+    static string adorn(const Predicate& predicate, const set<string>& bound, bool constantsBound = false);
+    static string adornedName(const string& name, const string& adornment);
+    static string magicName(const string& name, const string& adornment);
+    static vector<Parameter> boundParams(const Predicate& predicate, const string& adornment);
+
+    static vector<Predicate> orderBody(vector<Predicate> body, set<string> bound);
+
+    void require(const string& name, const string& adornment);
+    void rewriteRules(const string& name, const string& adornment);
+    void addFullRules();
+
+public:
+    MagicSets(DatalogProgram program);
+
+    DatalogProgram rewrite();
+};
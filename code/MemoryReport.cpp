@@ -0,0 +1,86 @@
+#include "MemoryReport.h"
+#include "Arena.h"
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <csignal>
+#include <algorithm>
+
+using namespace std;
+
+atomic<bool> MemoryReport::requested(false);
+
+static thread_local size_t passPeak = 0;
+
+void MemoryReport::relation(const string& name, size_t bytes)
+{
+    lock_guard<mutex> guard(lock);
+    relations[name].update(bytes);
+}
+
+void MemoryReport::scc(const string& name, size_t bytes)
+{
+    lock_guard<mutex> guard(lock);
+    sccs[name].update(bytes);
+}
+
+void MemoryReport::step(const string& name, size_t bytes)
+{
+    passPeak = max(passPeak, bytes);
+
+    //Called from inside a rule, but the entries are kept
+    ArenaPause pause;
+    lock_guard<mutex> guard(lock);
+    steps[name].update(bytes);
+}
+
+size_t MemoryReport::takePassPeak()
+{
+    size_t peak = passPeak;
+    passPeak = 0;
+    return peak;
+}
+
+void MemoryReport::print(ostream& out, const string& title, const map<string, Usage>& usages)
+{
+    out << title << endl;
+    for (auto& pair : usages)
+    {
+        out << "  " << pair.first << ": " << pair.second.current << " / " << pair.second.peak << endl;
+    }
+}
+
+//The process's own figures come from the kernel, resident and high water mark
+string MemoryReport::toString() const
+{
+    lock_guard<mutex> guard(lock);
+
+    stringstream out;
+    out << "Memory (bytes, current / peak)" << endl;
+    print(out, "Relations", relations);
+    print(out, "Rule steps", steps);
+    print(out, "SCCs", sccs);
+
+    ifstream status("/proc/self/status");
+    string line;
+    while (getline(status, line))
+    {
+        if (line.rfind("VmRSS:", 0) == 0 || line.rfind("VmHWM:", 0) == 0)
+        {
+            out << "Process " << line << endl;
+        }
+    }
+
+    return out.str();
+}
+
+void MemoryReport::listen()
+{
+    signal(SIGUSR1, [](int) { requested = true; });
+}
+
+bool MemoryReport::takeRequest()
+{
+    return requested.exchange(false);
+}
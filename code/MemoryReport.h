@@ -0,0 +1,60 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <cstddef>
+#include <algorithm>
+
+using namespace std;
+
+//Where the memory goes during a run: the current and peak bytes of every
+//relation, of each step of each rule (the immediate results, the joins and
+//the projection), and of each SCC. The byte counts are estimates from
+//walking the tuples, so keeping the report costs about as much as copying
+//what it measures, and nothing when it's off
+class MemoryReport
+{
+private:
+    struct Usage
+    {
+        Usage() : current(0), peak(0) {}
+
+        size_t current;
+        size_t peak;
+
+        void update(size_t bytes)
+        {
+            current = bytes;
+            peak = max(peak, bytes);
+        }
+    };
+
+    mutable mutex lock;
+    map<string, Usage> relations;
+    map<string, Usage> steps;
+    map<string, Usage> sccs;
+
+    //Set from a signal handler, so a long run can be asked for a report
+    static atomic<bool> requested;
+
+    static void print(ostream& out, const string& title, const map<string, Usage>& usages);
+
+public:
+    void relation(const string& name, size_t bytes);
+    void scc(const string& name, size_t bytes);
+
+    //An intermediate result. Also counts toward the largest one of the
+    //current pass on this thread
+    void step(const string& name, size_t bytes);
+
+    //The largest intermediate since the last call, on this thread
+    static size_t takePassPeak();
+
+    string toString() const;
+
+    //SIGUSR1 asks for a report at the next pass boundary
+    static void listen();
+    static bool takeRequest();
+};
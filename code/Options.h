@@ -0,0 +1,91 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+using namespace std;
+
+//How much of the run gets printed. Below Trace the rule evaluation isn't
+//printed (or worked out for printing) at all, and Counts leaves out the
+//query answers' tuples too
+enum class Verbosity
+{
+    Trace,
+    Queries,
+    Counts
+};
+
+//Settings for a run of the interpreter, filled in from the command line
+struct Options
+{
+    Options() : threads(1), jacobi(false), magic(false), prune(false), release(false), repl(false), resume(false), checkpointInterval(30), columnar(false), trie(false), memoryLimit(0), spillDir("/tmp"), memoryReport(false), arena(false), verbosity(Verbosity::Trace) {}
+
+    //Worker threads. Above 1 independent SCCs are evaluated concurrently
+    int threads;
+
+    //Evaluate the rules of an SCC in parallel against the relations as they
+    //were at the start of each pass. Can change the pass counts printed
+    bool jacobi;
+
+    //Rewrite the rules with magic sets so only tuples relevant to the query
+    //constants get derived. Query answers stay the same, the trace doesn't
+    bool magic;
+
+    //Skip the rules (and drop the relations) no query depends on
+    bool prune;
+
+    //Free each relation's tuples once the last SCC that uses it is done,
+    //unless a query needs it
+    bool release;
+
+    //Facts to add after the program has run. Only their consequences get
+    //derived, then the queries are answered again
+    string insertFile;
+
+    //Facts to take back after that, again without evaluating from scratch
+    string retractFile;
+
+    //Keep the evaluated database and answer requests from stdin, or from a
+    //Unix domain socket when a path is given
+    bool repl;
+    string socketPath;
+
+    //Save the evaluated database to a file that can be memory mapped later,
+    //or answer from such a file instead of evaluating the rules
+    string saveFile;
+    string loadFile;
+
+    //Log the rule evaluation to a file as it goes, at every SCC and at pass
+    //boundaries at most every checkpointInterval seconds. With resume a run
+    //picks up where the log ends instead of starting over
+    string checkpointFile;
+    bool resume;
+    double checkpointInterval;
+
+    //Directory of SCC results kept between runs. An SCC whose rules and
+    //input relations match an earlier run's gets its result from there
+    string cacheDir;
+
+    //Keep the relations no rule derives into compressed by column once the
+    //facts are in
+    bool columnar;
+
+    //Or as tries, sharing the leading columns rows have in common. Joins
+    //look rows up in them by the shared variables
+    bool trie;
+
+    //Bytes a rule's intermediate results can take up before they go to disk
+    //in spillDir, 0 for no limit
+    size_t memoryLimit;
+    string spillDir;
+
+    //Print where the memory went to stderr at the end, or on SIGUSR1
+    bool memoryReport;
+
+    //Allocate each rule's intermediate results from a per thread arena that
+    //is freed all at once when the rule is done
+    bool arena;
+
+    //--output trace, queries or counts
+    Verbosity verbosity;
+};
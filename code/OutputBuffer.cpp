@@ -0,0 +1,28 @@
+#include "OutputBuffer.h"
+
+using namespace std;
+
+void OutputBuffer::addTuples(const Relation& relation)
+{
+    Scheme scheme(relation.getSchemeNames());
+    for (const Tuple& tuple : relation)
+    {
+        buffer += "  ";
+        tuple.appendTo(buffer, scheme);
+        buffer += '\n';
+        spill();
+    }
+}
+
+void OutputBuffer::addTuples(QueryCursor& cursor)
+{
+    //One tuple reused for every answer, so its strings keep their room
+    Tuple tuple(vector<string>{});
+    while (cursor.next(tuple))
+    {
+        buffer += "  ";
+        tuple.appendTo(buffer, cursor.getScheme());
+        buffer += '\n';
+        spill();
+    }
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include "Relation.h"
+#include "QueryCursor.h"
+
+using namespace std;
+
+//Collects output text in one big buffer and hands it to the stream in large
+//chunks, so nothing gets flushed per line and tuples are formatted straight
+//into the buffer instead of through a stringstream each
+class OutputBuffer
+{
+private:
+    static const size_t CHUNK = 1 << 20;
+
+    string buffer;
+    ostream& sink;
+
+    void spill()
+    {
+        if (buffer.size() >= CHUNK)
+        {
+            flush();
+        }
+    }
+
+public:
+    OutputBuffer(ostream& sink) : sink(sink) {}
+
+    OutputBuffer(const OutputBuffer&) = delete;
+
+    ~OutputBuffer()
+    {
+        flush();
+    }
+
+    OutputBuffer& operator<<(const string& text)
+    {
+        buffer += text;
+        spill();
+        return *this;
+    }
+
+    OutputBuffer& operator<<(const char* text)
+    {
+        buffer += text;
+        spill();
+        return *this;
+    }
+
+    OutputBuffer& operator<<(char c)
+    {
+        buffer += c;
+        return *this;
+    }
+
+    OutputBuffer& operator<<(int number)
+    {
+        buffer += to_string(number);
+        return *this;
+    }
+
+    //One "  name=value, ..." line per tuple, the way Relation::toString
+    //prints them but ending the last line too
+    void addTuples(const Relation& relation);
+
+    //The same for the rest of a query's answers
+    void addTuples(QueryCursor& cursor);
+
+    //Hands what's buffered to the stream, which is left to flush itself
+    void flush()
+    {
+        sink.write(buffer.data(), buffer.size());
+        buffer.clear();
+    }
+};
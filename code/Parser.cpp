@@ -31,6 +31,43 @@ bool Parser::parse()
     return true;
 }
 
+//Just a list of facts, for adding to a program that has already been run
+bool Parser::parseFacts()
+{
+    return parseList(&Parser::factList);
+}
+
+bool Parser::parseQueries()
+{
+    return parseList(&Parser::queryList);
+}
+
+bool Parser::parseRules()
+{
+    return parseList(&Parser::ruleList);
+}
+
+bool Parser::parseList(void (Parser::*list)())
+{
+    while(tokens.begin()->getType() == COMMENT)
+    {
+        tokens.erase(tokens.begin());
+    } 
+
+    try
+    {
+        (this->*list)();
+        match(_EOF);
+    }
+    catch(Token e)
+    {
+        errorToken = e;
+        return false;
+    }
+
+    return true;
+}
+
 DatalogProgram Parser::getDatalogProgram()
 {
     return datalogObject;
@@ -18,6 +18,7 @@ private:
     void advanceToken();
     void throwError();
     Token match(TokenType t);
+    bool parseList(void (Parser::*list)());
 
     //Grammar rules
     void datalogProgram();
@@ -45,6 +46,9 @@ private:
 public:
     Parser(const vector<Token>& tokens, bool isDebug = false);
     bool parse();
+    bool parseFacts();
+    bool parseQueries();
+    bool parseRules();
 
     DatalogProgram getDatalogProgram();
     Token getErrorToken();
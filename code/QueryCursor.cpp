@@ -0,0 +1,260 @@
+#include "QueryCursor.h"
+#include "Query.h"
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+QueryCursor::QueryCursor(const Relation& relation, const Predicate& query)
+    : scheme(vector<string>()), prefix(vector<string>())
+{
+    setUp(relation, query);
+    addSource(relation, 0, false);
+    rewind();
+}
+
+QueryCursor::QueryCursor(shared_ptr<const Relation> relation, const Predicate& query)
+    : QueryCursor(*relation, query)
+{
+    kept.push_back(relation);
+}
+
+QueryCursor::QueryCursor(const LayeredRelation& relation, const Predicate& query)
+    : scheme(vector<string>()), prefix(vector<string>())
+{
+    setUp(*relation.base, query);
+
+    kept.push_back(relation.base);
+    addSource(*relation.base, 0, false);
+    for (unsigned int i = 0; i < relation.layers.size(); i++)
+    {
+        kept.push_back(relation.layers.at(i).first);
+        kept.push_back(relation.layers.at(i).second);
+        addSource(*relation.layers.at(i).first, i + 1, false);
+        addSource(*relation.layers.at(i).second, i + 1, true);
+    }
+
+    rewind();
+}
+
+void QueryCursor::setUp(const Relation& relation, const Predicate& query)
+{
+    Query params(query.getParams());
+    if (params.size() != relation.getSchemeNames().size())
+    {
+        throw invalid_argument("The query must have the same size as the scheme");
+    }
+
+    for (int column : params.getConstants())
+    {
+        constants.push_back({column, params.at(column).value});
+    }
+
+    //Each variable is kept at its first column, the others have to match it
+    vector<pair<int, string>> kept;
+    for (auto& variable : params.getVariables())
+    {
+        const vector<int>& positions = variable.second;
+        kept.push_back({positions.at(0), variable.first});
+        for (unsigned int i = 1; i < positions.size(); i++)
+        {
+            repeats.push_back({positions.at(i), positions.at(0)});
+        }
+    }
+
+    sort(kept.begin(), kept.end());
+    vector<string> names;
+    for (auto& column : kept)
+    {
+        columns.push_back(column.first);
+        names.push_back(column.second);
+    }
+    scheme = Scheme(names);
+
+    for (unsigned int i = 0; i < params.size() && !params.at(i).isId; i++)
+    {
+        prefix.push_back(params.at(i).value);
+    }
+}
+
+void QueryCursor::addSource(const Relation& relation, int layer, bool removes)
+{
+    //Nothing to walk in an empty layer
+    if (relation.size() == 0 && layer > 0)
+    {
+        return;
+    }
+
+    Source source;
+    source.relation = &relation;
+    source.layer = layer;
+    source.removes = removes;
+    sources.push_back(source);
+}
+
+bool QueryCursor::matches(const Tuple& tuple) const
+{
+    for (auto& constant : constants)
+    {
+        if (tuple[constant.first] != constant.second)
+        {
+            return false;
+        }
+    }
+
+    for (auto& repeat : repeats)
+    {
+        if (tuple[repeat.first] != tuple[repeat.second])
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+//Moves the source on to its next matching tuple, or to its end once it's
+//past the range the leading constants pick out
+void QueryCursor::settle(Source& source)
+{
+    set<Tuple>::const_iterator end = source.relation->end();
+    for (; source.it != end; ++source.it)
+    {
+        if (!equal(prefix.begin(), prefix.end(), source.it->begin()))
+        {
+            source.it = end;
+            return;
+        }
+
+        if (matches(*source.it))
+        {
+            return;
+        }
+    }
+}
+
+void QueryCursor::rewind()
+{
+    //A prefix sorts just before every tuple that starts with it
+    for (Source& source : sources)
+    {
+        source.it = prefix.empty() ? source.relation->begin() : source.relation->lowerBound(prefix);
+        settle(source);
+    }
+
+    run = -1;
+    bound = -1;
+}
+
+//The next matching tuple that's there, nullptr once there are none. Of the
+//sources with the smallest tuple, the newest layer decides, and a layer
+//that both removes and adds it adds it
+const Tuple* QueryCursor::step()
+{
+    while (true)
+    {
+        //While one source is below every other one's next tuple, it's the
+        //only one with its tuples and they come straight from it
+        if (run >= 0)
+        {
+            Source& source = sources[run];
+            if (source.it != source.relation->end() && (bound < 0 || *source.it < *sources[bound].it))
+            {
+                const Tuple* tuple = &*source.it;
+                ++source.it;
+                settle(source);
+                if (!source.removes)
+                {
+                    return tuple;
+                }
+                continue;
+            }
+        }
+
+        const Tuple* smallest = nullptr;
+        Source* chosen = nullptr;
+        for (Source& source : sources)
+        {
+            if (source.it == source.relation->end())
+            {
+                continue;
+            }
+
+            const Tuple& tuple = *source.it;
+            if (smallest == nullptr || tuple < *smallest)
+            {
+                smallest = &tuple;
+                chosen = &source;
+            }
+            else if (tuple == *smallest && (source.layer > chosen->layer || (source.layer == chosen->layer && !source.removes)))
+            {
+                chosen = &source;
+            }
+        }
+
+        if (smallest == nullptr)
+        {
+            return nullptr;
+        }
+
+        //Set elements stay where they are, so smallest is still good after
+        for (Source& source : sources)
+        {
+            if (&source != chosen && source.it != source.relation->end() && *source.it == *smallest)
+            {
+                ++source.it;
+                settle(source);
+            }
+        }
+        ++chosen->it;
+        settle(*chosen);
+
+        //The chosen source runs on until it reaches another source's tuple
+        run = chosen - &sources[0];
+        bound = -1;
+        for (unsigned int i = 0; i < sources.size(); i++)
+        {
+            const Source& source = sources[i];
+            if ((int)i != run && source.it != source.relation->end() && (bound < 0 || *source.it < *sources[bound].it))
+            {
+                bound = i;
+            }
+        }
+
+        if (!chosen->removes)
+        {
+            return smallest;
+        }
+    }
+}
+
+bool QueryCursor::next(Tuple& tuple)
+{
+    const Tuple* found = step();
+    if (found == nullptr)
+    {
+        return false;
+    }
+
+    tuple.resize(columns.size());
+    for (unsigned int i = 0; i < columns.size(); i++)
+    {
+        tuple[i] = (*found)[columns[i]];
+    }
+
+    return true;
+}
+
+int QueryCursor::count() const
+{
+    QueryCursor walk = *this;
+    walk.rewind();
+
+    int total = 0;
+    while (walk.step() != nullptr)
+    {
+        total++;
+    }
+
+    return total;
+}
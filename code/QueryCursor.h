@@ -0,0 +1,85 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <set>
+#include <memory>
+#include "Relation.h"
+#include "LayeredRelation.h"
+#include "Predicate.h"
+
+using namespace std;
+
+//Walks the answers to a query one tuple at a time, straight off the
+//relation's sorted tuples, so nothing is collected however many there are.
+//
+//The answer keeps the first column of each variable, in column order. Two
+//matching tuples are equal on the constant columns and on any column that
+//repeats a variable, so the first column they differ in is one that's kept:
+//the answers come out sorted with no duplicates, in the relation's order.
+//
+//A layered relation gets walked as a merge of its base and layers. The
+//relation mustn't change while the cursor is in use
+class QueryCursor
+{
+private:
+    struct Source
+    {
+        const Relation* relation;
+
+        //0 for the base, higher for newer layers
+        int layer;
+
+        //Its tuples are taken out rather than put in
+        bool removes;
+
+        set<Tuple>::const_iterator it;
+    };
+
+    vector<shared_ptr<const Relation>> kept;
+    vector<Source> sources;
+
+    vector<pair<int, string>> constants;
+    vector<pair<int, int>> repeats;
+    vector<int> columns;
+    Scheme scheme;
+
+    //The constants at the start of the query narrow it to one range
+    Tuple prefix;
+
+    //The source step is taking tuples straight from, up to the next tuple
+    //of the bound source, -1 for none. Indexes into sources so a copy of
+    //the cursor carries on from its own sources
+    int run;
+    int bound;
+
+    void setUp(const Relation& relation, const Predicate& query);
+    void addSource(const Relation& relation, int layer, bool removes);
+    bool matches(const Tuple& tuple) const;
+    void settle(Source& source);
+    const Tuple* step();
+
+public:
+    QueryCursor(const Relation& relation, const Predicate& query);
+
+    //For a relation only the cursor needs, like a frozen relation's matches
+    QueryCursor(shared_ptr<const Relation> relation, const Predicate& query);
+
+    //Keeps the layers it walks for as long as it's around
+    QueryCursor(const LayeredRelation& relation, const Predicate& query);
+
+    //The next answer into tuple, false once there are none left
+    bool next(Tuple& tuple);
+
+    //Back to the first answer
+    void rewind();
+
+    //How many answers there are, walking the range without moving the cursor
+    int count() const;
+
+    //The query's variables, one per column of the answers
+    const Scheme& getScheme() const
+    {
+        return scheme;
+    }
+};
@@ -7,6 +7,13 @@
 #include "Scheme.h"
 #include "Tuple.h"
 #include "Relation.h"
+#include "TupleKey.h"
+#include "ThreadPool.h"
+#include "Query.h"
+#include <vector>
+#include <unordered_map>
+#include <queue>
+#include <algorithm>
 
 using namespace std;
 
@@ -19,27 +26,66 @@ Relation::Relation(const string& name, const Scheme& scheme, set<Tuple> tuples)
     }   
 }
 
-void Relation::addTuple(const Tuple& tuple) {
+//Returns true if the tuple wasn't already there
+bool Relation::addTuple(const Tuple& tuple) {
     if (tuple.size() != scheme.size()) {
         throw invalid_argument("Tuple must have the same size as the scheme");
     }
 
-    tuples.insert(tuple);
+    if (!tuples.insert(tuple).second)
+    {
+        return false;
+    }
+
+    //The filter starts at the threshold and is built again twice as big
+    //whenever it fills up, so its cost stays proportional to the inserts
+    if (!filter.empty() && !filter.full())
+    {
+        filter.insert(TupleHash()(tuple));
+    }
+    else if (tuples.size() >= FILTER_MIN_TUPLES)
+    {
+        filter = BloomFilter(tuples.size() * 2);
+        for (const Tuple& member : tuples)
+        {
+            filter.insert(TupleHash()(member));
+        }
+    }
+
+    return true;
+}
+
+//Returns true if the tuple was there. Its bits stay in the filter, which
+//only costs a wasted lookup now and then
+bool Relation::removeTuple(const Tuple& tuple)
+{
+    return tuples.erase(tuple) > 0;
+}
+
+bool Relation::contains(const Tuple& tuple) const
+{
+    if (!filter.empty() && !filter.mayContain(TupleHash()(tuple)))
+    {
+        return false;
+    }
+
+    return tuples.count(tuple) > 0;
 }
 
 string Relation::toString() const {
-    stringstream out;
+    string out;
     unsigned int i = 0;
     for (auto& tuple : tuples) {
-        out << "  " << tuple.toString(scheme);
+        out += "  ";
+        tuple.appendTo(out, scheme);
         i++;
 
         if (i < tuples.size())
         {
-            out << endl;
+            out += '\n';
         }
     }
-    return out.str();
+    return out;
 }
 
 string Relation::getName() const
@@ -57,11 +103,57 @@ void Relation::setName(string name)
     this->name = name;
 }
 
+set<Tuple>::const_iterator Relation::begin() const
+{
+    return tuples.begin();
+}
+
+set<Tuple>::const_iterator Relation::end() const
+{
+    return tuples.end();
+}
+
+set<Tuple>::const_iterator Relation::lowerBound(const Tuple& tuple) const
+{
+    return tuples.lower_bound(tuple);
+}
+
+//Drops the tuples and hands their memory back
+void Relation::clear()
+{
+    set<Tuple>().swap(tuples);
+    filter = BloomFilter();
+}
+
 int Relation::size() const
 {
     return tuples.size();
 }
 
+size_t Relation::bytes() const
+{
+    size_t total = sizeof(*this) + scheme.size() * sizeof(string) + filter.bytes();
+    for (const Tuple& tuple : tuples)
+    {
+        total += tupleBytes(tuple);
+    }
+
+    return total;
+}
+
+size_t Relation::tupleBytes(const Tuple& tuple)
+{
+    //The set node and the vector, then each string and its heap copy if it
+    //has one
+    size_t bytes = 32 + sizeof(Tuple);
+    for (const string& value : tuple)
+    {
+        bytes += sizeof(string) + (value.capacity() > 15 ? value.capacity() + 1 : 0);
+    }
+
+    return bytes;
+}
+
 Relation Relation::select(int index, const string& value) const {
     Relation result(name, scheme);
     for (auto& tuple : tuples)
@@ -78,23 +170,176 @@ Relation Relation::select(vector<int> positions) const
         throw invalid_argument("No positions");
     }
 
+    //Compare every position against the first one
+    vector<int> firsts(positions.size() - 1, positions[0]);
+    vector<int> others(positions.begin() + 1, positions.end());
+    TupleKey key(firsts, others);
+
     Relation result(name, scheme);
     for (auto& tuple : tuples) {
-        int first = positions[0];
-        bool isEqual = true;
+        if (key.matches(tuple, tuple))
+        {
+            result.tuples.insert(result.tuples.end(), tuple);
+        }
+    }
+
+    return result;
+}
+
+Relation Relation::select(const Predicate& predicate, const Relation* joinWith) const
+{
+    Query query(predicate.getParams());
+    if (query.size() != scheme.size())
+    {
+        throw invalid_argument("The predicate must have the same size as the scheme");
+    }
+
+    vector<pair<int, string>> constants;
+    for (int column : query.getConstants())
+    {
+        constants.push_back({column, query.at(column).value});
+    }
+
+    //Each variable's later columns have to match its first one, and its
+    //first one has to match the other side of the join if it's there too
+    vector<pair<int, int>> repeats;
+    vector<int> sharedColumns;
+    vector<int> joinColumns;
+    vector<string> joinNames = joinWith != nullptr ? joinWith->getSchemeNames() : vector<string>();
+    for (auto& variable : query.getVariables())
+    {
+        const vector<int>& positions = variable.second;
         for (unsigned int i = 1; i < positions.size(); i++)
         {
-            int curr = positions[i];
-            if (tuple.at(curr) != tuple.at(first))
+            repeats.push_back({positions.at(i), positions.at(0)});
+        }
+
+        auto it = find(joinNames.begin(), joinNames.end(), variable.first);
+        if (it != joinNames.end())
+        {
+            sharedColumns.push_back(positions.at(0));
+            joinColumns.push_back(it - joinNames.begin());
+        }
+    }
+
+    auto matches = [&](const Tuple& tuple)
+    {
+        for (auto& constant : constants)
+        {
+            if (tuple[constant.first] != constant.second)
             {
-                isEqual = false;
-                break;
+                return false;
             }
         }
 
-        if (isEqual)
+        for (auto& repeat : repeats)
         {
-            result.addTuple(tuple);
+            if (tuple[repeat.first] != tuple[repeat.second])
+            {
+                return false;
+            }
+        }
+
+        return true;
+    };
+
+    //The other side's tuples by their values on the shared variables
+    TupleKey key(joinColumns, sharedColumns);
+    unordered_multimap<size_t, const Tuple*> partners;
+    if (!sharedColumns.empty())
+    {
+        partners.reserve(joinWith->size());
+        for (const Tuple& tuple : *joinWith)
+        {
+            partners.insert({key.hashLeft(tuple), &tuple});
+        }
+    }
+
+    if (!sharedColumns.empty() && joinWith->size() == 0)
+    {
+        return Relation(name, scheme);
+    }
+
+    auto hasPartner = [&](const Tuple& tuple)
+    {
+        if (sharedColumns.empty())
+        {
+            return true;
+        }
+
+        auto found = partners.equal_range(key.hashRight(tuple));
+        for (auto it = found.first; it != found.second; it++)
+        {
+            if (key.matches(*it->second, tuple))
+            {
+                return true;
+            }
+        }
+
+        return false;
+    };
+
+    //Where a column's value comes from when it's known up front: a constant,
+    //or (-1 - i) for column i of the other side
+    map<int, int> known;
+    for (unsigned int i = 0; i < constants.size(); i++)
+    {
+        known[constants.at(i).first] = i;
+    }
+    for (unsigned int i = 0; i < sharedColumns.size(); i++)
+    {
+        known[sharedColumns.at(i)] = -1 - joinColumns.at(i);
+    }
+
+    unsigned int prefixSize = 0;
+    while (known.count(prefixSize) > 0)
+    {
+        prefixSize++;
+    }
+
+    bool prefixFromJoin = false;
+    for (unsigned int i = 0; i < prefixSize; i++)
+    {
+        prefixFromJoin = prefixFromJoin || known.at(i) < 0;
+    }
+
+    //The tuples starting with each prefix are a range of the set. The
+    //prefixes come out sorted and so do the ranges, so everything goes in
+    //at the end
+    set<Tuple> prefixes;
+    if (!prefixFromJoin)
+    {
+        vector<string> prefix;
+        for (unsigned int i = 0; i < prefixSize; i++)
+        {
+            prefix.push_back(constants.at(known.at(i)).second);
+        }
+        prefixes.insert(Tuple(prefix));
+    }
+    else
+    {
+        for (const Tuple& tuple : *joinWith)
+        {
+            vector<string> prefix;
+            for (unsigned int i = 0; i < prefixSize; i++)
+            {
+                int from = known.at(i);
+                prefix.push_back(from >= 0 ? constants.at(from).second : tuple[-1 - from]);
+            }
+            prefixes.insert(Tuple(prefix));
+        }
+    }
+
+    Relation result(name, scheme);
+    for (const Tuple& prefix : prefixes)
+    {
+        auto it = prefix.empty() ? tuples.begin() : tuples.lower_bound(prefix);
+        for (; it != tuples.end() && equal(prefix.begin(), prefix.end(), it->begin()); it++)
+        {
+            if (matches(*it) && hasPartner(*it))
+            {
+                result.tuples.insert(result.tuples.end(), *it);
+            }
         }
     }
 
@@ -144,14 +389,7 @@ Relation Relation::project(vector<int> columns) const
     //Loop through the tuples and with the new columns
     for (auto& tuple : tuples)
     {
-        vector<string> values;
-        Tuple newTuple(values);
-        for (auto& index : columns)
-        {
-            newTuple.push_back(tuple.at(index));
-        }
-
-        result.addTuple(newTuple);
+        result.addTuple(copyColumns(tuple, columns));
     }
 
     return result;
@@ -175,23 +413,36 @@ Relation Relation::rename(vector<string> newNames) const
     return result;
 }
 
-Relation Relation::join(const Relation& r)
+//Rows per partition to aim for so a partition's hash table stays in cache
+static const unsigned int PARTITION_ROWS = 4096;
+static const unsigned int MAX_PARTITIONS = 1024;
+
+Relation Relation::join(const Relation& r, ThreadPool* pool)
 {
     const Scheme& leftScheme = scheme;
     const Scheme& rightScheme = r.scheme;
 
     Scheme newScheme = joinSchemes(leftScheme, rightScheme);
 
+    //Work out the shared and right only columns once instead of per tuple
+    TupleKey key = joinKey(leftScheme, rightScheme);
+    vector<int> rightColumns = rightOnlyColumns(leftScheme, rightScheme);
+
+    //No shared columns is a cross product, there is nothing to hash on
+    if (key.size() > 0)
+    {
+        return hashJoin(r, key, rightColumns, newScheme, pool);
+    }
+
     Relation result(name, newScheme);
 
     for (const Tuple& leftTuple : tuples) 
     {
         for (const Tuple& rightTuple : r.tuples) 
         {
-            if (joinable(leftScheme, rightScheme, leftTuple, rightTuple))
+            if (key.matches(leftTuple, rightTuple))
             {
-                Tuple tuple = result.joinTuples(rightScheme, leftTuple, rightTuple);
-                result.addTuple(tuple);
+                result.tuples.insert(joinTuples(leftTuple, rightTuple, rightColumns));
             }
         }
     }
@@ -199,6 +450,132 @@ Relation Relation::join(const Relation& r)
     return result;
 }
 
+//Radix partitions both sides on the hash of the join key, then builds and
+//probes a hash table per partition. Every output tuple holds its partition's
+//key, so no two partitions make the same tuple: each one fills its own
+//vector, sorts it, and the sorted vectors are merged into the result once
+Relation Relation::hashJoin(const Relation& r, const TupleKey& key, const vector<int>& rightColumns,
+                            const Scheme& resultScheme, ThreadPool* pool) const
+{
+    unsigned int partitionCount = 1;
+    unsigned int rows = tuples.size() + r.tuples.size();
+    while (partitionCount < MAX_PARTITIONS && partitionCount * PARTITION_ROWS < rows)
+    {
+        partitionCount *= 2;
+    }
+
+    //Only worth splitting up if there is someone to hand the partitions to
+    if (pool == nullptr || pool->size() == 1)
+    {
+        partitionCount = 1;
+    }
+
+    typedef pair<size_t, const Tuple*> Entry;
+    vector<vector<Entry>> leftPartitions(partitionCount);
+    vector<vector<Entry>> rightPartitions(partitionCount);
+
+    //Use the high bits to pick the partition, the low ones go to the hash tables
+    for (const Tuple& tuple : tuples)
+    {
+        size_t hash = key.hashLeft(tuple);
+        leftPartitions.at((hash >> (sizeof(size_t) * 8 - 16)) & (partitionCount - 1)).push_back(Entry(hash, &tuple));
+    }
+
+    for (const Tuple& tuple : r.tuples)
+    {
+        size_t hash = key.hashRight(tuple);
+        rightPartitions.at((hash >> (sizeof(size_t) * 8 - 16)) & (partitionCount - 1)).push_back(Entry(hash, &tuple));
+    }
+
+    Relation result(name, resultScheme);
+    vector<vector<Tuple>> outputs(partitionCount);
+
+    auto joinPartition = [&](int index) {
+        vector<Entry>& leftPartition = leftPartitions.at(index);
+        vector<Entry>& rightPartition = rightPartitions.at(index);
+        if (leftPartition.empty() || rightPartition.empty())
+        {
+            return;
+        }
+
+        //Build on the right side, probe with the left
+        unordered_multimap<size_t, const Tuple*> table;
+        table.reserve(rightPartition.size());
+        for (Entry& entry : rightPartition)
+        {
+            table.insert(entry);
+        }
+
+        vector<Tuple>& output = outputs.at(index);
+        key.dispatch([&](auto keyMatches) {
+            for (Entry& entry : leftPartition)
+            {
+                auto matches = table.equal_range(entry.first);
+                for (auto it = matches.first; it != matches.second; it++)
+                {
+                    if (!keyMatches(*entry.second, *it->second))
+                    {
+                        continue;
+                    }
+
+                    if (partitionCount == 1)
+                    {
+                        result.tuples.insert(joinTuples(*entry.second, *it->second, rightColumns));
+                    }
+                    else
+                    {
+                        output.push_back(joinTuples(*entry.second, *it->second, rightColumns));
+                    }
+                }
+            }
+        });
+
+        sort(output.begin(), output.end());
+    };
+
+    if (partitionCount == 1)
+    {
+        joinPartition(0);
+        return result;
+    }
+
+    pool->run(partitionCount, joinPartition);
+
+    mergeRuns(outputs, result);
+    return result;
+}
+
+//Merges sorted runs into the relation, every tuple lands at the end of the
+//set. Copies of a tuple in more than one run are kept once
+void Relation::mergeRuns(vector<vector<Tuple>>& runs, Relation& result)
+{
+    typedef pair<const Tuple*, unsigned int> Head;
+    auto greater = [](const Head& a, const Head& b) { return *b.first < *a.first; };
+    priority_queue<Head, vector<Head>, decltype(greater)> heads(greater);
+    vector<unsigned int> positions(runs.size(), 0);
+
+    for (unsigned int i = 0; i < runs.size(); i++)
+    {
+        if (!runs.at(i).empty())
+        {
+            heads.push(Head(&runs.at(i).at(0), i));
+        }
+    }
+
+    while (!heads.empty())
+    {
+        unsigned int run = heads.top().second;
+        heads.pop();
+
+        result.tuples.insert(result.tuples.end(), move(runs.at(run).at(positions.at(run))));
+
+        if (++positions.at(run) < runs.at(run).size())
+        {
+            heads.push(Head(&runs.at(run).at(positions.at(run)), run));
+        }
+    }
+}
+
 Relation Relation::Union(const Relation& r)
 {
     invalid_argument exception("The relations " + name + " and " + r.name + " are not union compatible");
@@ -233,18 +610,13 @@ Relation Relation::diff(const Relation& r)
     //Our resulting relation with the difference
     Relation result(name, scheme);
 
-    //A way to see what the difference is
-    Relation temp(r.name, r.scheme, r.tuples);
-
+    //Most tuples that are new get turned away by r's filter without a look
+    //at its tree. They come out in order, so each one goes on the end
     for (const Tuple& tuple : tuples)
     {
-        int origSize = temp.size();
-        temp.addTuple(tuple);
-
-        //If the size changed, that means we have found a difference
-        if (temp.size() > origSize)
+        if (!r.contains(tuple))
         {
-            result.addTuple(tuple);
+            result.tuples.emplace_hint(result.tuples.end(), tuple);
         }
     }
 
@@ -276,18 +648,36 @@ Scheme Relation::joinSchemes(const Scheme& leftScheme, const Scheme& rightScheme
     return result;
 }
 
-Tuple Relation::joinTuples(const Scheme& rightScheme, const Tuple& leftTuple, const Tuple& rightTuple)
+TupleKey Relation::joinKey(const Scheme& leftScheme, const Scheme& rightScheme)
 {
-    Tuple result(leftTuple);
+    vector<int> leftColumns;
+    vector<int> rightColumns;
+
+    for (unsigned leftIndex = 0; leftIndex < leftScheme.size(); leftIndex++) 
+    {
+        for (unsigned rightIndex = 0; rightIndex < rightScheme.size(); rightIndex++) 
+        {
+            if (leftScheme.at(leftIndex) == rightScheme.at(rightIndex))
+            {
+                leftColumns.push_back(leftIndex);
+                rightColumns.push_back(rightIndex);
+            }
+        }
+    }
+
+    return TupleKey(leftColumns, rightColumns);
+}
+
+vector<int> Relation::rightOnlyColumns(const Scheme& leftScheme, const Scheme& rightScheme)
+{
+    vector<int> columns;
 
     for (unsigned int i = 0; i < rightScheme.size(); i++) 
     {
-        string rightName = rightScheme.at(i);
         bool isSame = false;
-        for (unsigned int j = 0; j < leftTuple.size(); j++)
+        for (const string& leftName : leftScheme)
         {
-            string leftName = scheme.at(j);
-            if (rightName == leftName)
+            if (rightScheme.at(i) == leftName)
             {
                 isSame = true;
                 break;
@@ -296,37 +686,23 @@ Tuple Relation::joinTuples(const Scheme& rightScheme, const Tuple& leftTuple, co
 
         if (!isSame)
         {
-            result.push_back(rightTuple.at(i));
+            columns.push_back(i);
         }
     }
 
-    if (scheme.size() != result.size())
-    {
-        throw runtime_error("Something went wrong with combining these tuples: " + leftTuple.toString(scheme) + rightTuple.toString(scheme));
-    }
-
-    return result;
+    return columns;
 }
 
-bool Relation::joinable (const Scheme& leftScheme, const Scheme& rightScheme,
-		       const Tuple& leftTuple, const Tuple& rightTuple)
+Tuple Relation::joinTuples(const Tuple& leftTuple, const Tuple& rightTuple, const vector<int>& rightColumns)
 {
-    for (unsigned leftIndex = 0; leftIndex < leftScheme.size(); leftIndex++) {
-        const string& leftName = leftScheme.at(leftIndex);
-        const string& leftValue = leftTuple.at(leftIndex);
-        
-        for (unsigned rightIndex = 0; rightIndex < rightScheme.size(); rightIndex++) {
-            const string& rightName = rightScheme.at(rightIndex);
-            const string& rightValue = rightTuple.at(rightIndex);
-            
-            if (rightName == leftName && rightValue != leftValue)
-            {
-                return false;
-            }
-        }
-    }
+    vector<string> values;
+    values.reserve(leftTuple.size() + rightColumns.size());
+    values.insert(values.end(), leftTuple.begin(), leftTuple.end());
 
-    
+    for (int column : rightColumns) 
+    {
+        values.push_back(rightTuple[column]);
+    }
 
-    return true;
+    return Tuple(move(values));
 }
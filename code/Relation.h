@@ -6,21 +6,41 @@
 #include <map>
 #include "Scheme.h"
 #include "Tuple.h"
+#include "TupleKey.h"
+#include "BloomFilter.h"
+#include "Predicate.h"
 
 using namespace std;
 
+class ThreadPool;
+
 class Relation {
 
+  friend class ColumnarRelation;
+  friend class TrieRelation;
+  friend class ExternalRelation;
+
  private:
 
   string name;
   Scheme scheme;
   set<Tuple> tuples;
 
-  static bool joinable (const Scheme& leftScheme, const Scheme& rightScheme,
-		       const Tuple& leftTuple, const Tuple& rightTuple);
+  //Only kept once the relation is big enough for the tree walks to hurt.
+  //Tuples put straight into the set (by friends filling a new relation)
+  //get added when it's built, so it covers every tuple from then on
+  BloomFilter filter;
+  static const size_t FILTER_MIN_TUPLES = 1024;
+
+  static TupleKey joinKey(const Scheme& leftScheme, const Scheme& rightScheme);
+  static vector<int> rightOnlyColumns(const Scheme& leftScheme, const Scheme& rightScheme);
+
+  Relation hashJoin(const Relation& r, const TupleKey& key, const vector<int>& rightColumns,
+                    const Scheme& resultScheme, ThreadPool* pool) const;
+
+  static void mergeRuns(vector<vector<Tuple>>& runs, Relation& result);
 
-  Tuple joinTuples(const Scheme& rightScheme, const Tuple& leftTuple, const Tuple& rightTuple);
+  static Tuple joinTuples(const Tuple& leftTuple, const Tuple& rightTuple, const vector<int>& rightColumns);
   Scheme joinSchemes(const Scheme& leftScheme, const Scheme& rightScheme);
 
  public:
@@ -30,19 +50,29 @@ class Relation {
 
     Relation(const string& name, const Scheme& scheme, set<Tuple> tuples);
 
-  void addTuple(const Tuple& tuple);
+  bool addTuple(const Tuple& tuple);
+  bool removeTuple(const Tuple& tuple);
+  bool contains(const Tuple& tuple) const;
 
   string toString() const;
 
   Relation select(int index, const string& value) const;
   Relation select(vector<int> positions) const;
 
+  //The tuples matching a predicate's constants and repeated variables, read
+  //straight off the set so only they get copied. Given the relation it's
+  //about to be joined with, tuples without a partner there on the shared
+  //variables are left out too
+  Relation select(const Predicate& predicate, const Relation* joinWith = nullptr) const;
+
   Relation project(vector<int> columns) const;
   Relation project(vector<string> columns) const;
 
   Relation rename(vector<string> newNames) const;
 
-  Relation join(const Relation& r);
+  //Joins on the shared column names. Given a pool, large joins get split into
+  //hash partitions that are joined in parallel
+  Relation join(const Relation& r, ThreadPool* pool = nullptr);
   Relation Union(const Relation& r);
 
   Relation diff(const Relation& r);
@@ -50,6 +80,17 @@ class Relation {
   string getName() const;
   vector<string> getSchemeNames() const;
 
+  set<Tuple>::const_iterator begin() const;
+  set<Tuple>::const_iterator end() const;
+
+  //The first tuple not before the given one, which can be just a prefix
+  set<Tuple>::const_iterator lowerBound(const Tuple& tuple) const;
+
   void setName(string name);
+  void clear();
   int size() const;
+
+  //Roughly the memory the tuples take up, walking all of them
+  size_t bytes() const;
+  static size_t tupleBytes(const Tuple& tuple);
 };
\ No newline at end of file
@@ -0,0 +1,231 @@
+#include "Repl.h"
+#include "Scanner.h"
+#include "Parser.h"
+#include <string>
+#include <sstream>
+#include <chrono>
+#include <iomanip>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <thread>
+
+using namespace std;
+
+Repl::Repl(Interpreter& interpreter, const DatabaseFile* file) : interpreter(interpreter), file(file), clients(0)
+{
+    if (file == nullptr)
+    {
+        interpreter.enableSnapshots();
+    }
+}
+
+vector<Token> Repl::scan(const string& line)
+{
+    //The scanner expects the input to end with a newline
+    Scanner s(line + "\n");
+    vector<Token> tokens;
+
+    Token t;
+    do
+    {
+        t = s.scanToken();
+        tokens.push_back(t);
+    } while (t.getType() != _EOF);
+
+    return tokens;
+}
+
+string Repl::describe(const Database& delta, const string& what)
+{
+    stringstream out;
+    out << what << endl;
+
+    for (auto& pair : delta)
+    {
+        out << pair.first << ": " << pair.second.size() << " new" << endl;
+    }
+
+    return out.str();
+}
+
+string Repl::handle(const string& line)
+{
+    auto start = chrono::steady_clock::now();
+
+    vector<Token> tokens = scan(line);
+    TokenType kind = PERIOD;
+    for (Token& token : tokens)
+    {
+        if (token.getType() == Q_MARK || token.getType() == COLON_DASH)
+        {
+            kind = token.getType();
+        }
+    }
+
+    string answer;
+    Parser parser(tokens);
+
+    try
+    {
+        if (file != nullptr && kind != Q_MARK)
+        {
+            answer = "Failure!\n  A saved database can only be queried\n";
+        }
+        else if (file != nullptr && parser.parseQueries())
+        {
+            for (Predicate& query : parser.getDatalogProgram().getQueries())
+            {
+                answer += interpreter.answerQuery(query, *file);
+            }
+        }
+        else if (kind == Q_MARK && parser.parseQueries())
+        {
+            //Every query on the line sees the same version
+            shared_ptr<const Snapshot> snapshot = interpreter.snapshot();
+            for (Predicate& query : parser.getDatalogProgram().getQueries())
+            {
+                answer += interpreter.answerQuery(query, *snapshot);
+            }
+        }
+        else if (kind == COLON_DASH && parser.parseRules())
+        {
+            lock_guard<mutex> guard(writeLock);
+            for (Rule& rule : parser.getDatalogProgram().getRules())
+            {
+                answer += describe(interpreter.addRule(rule), "Added " + rule.toString());
+            }
+        }
+        else if (kind == PERIOD && parser.parseFacts())
+        {
+            lock_guard<mutex> guard(writeLock);
+            answer = describe(interpreter.insertFacts(parser.getDatalogProgram().getFacts()), "Fact Insertion");
+        }
+        else
+        {
+            answer = "Failure!\n  " + parser.getErrorToken().toString() + "\n";
+        }
+    }
+    catch (invalid_argument& e)
+    {
+        answer = string("Failure!\n  ") + e.what() + "\n";
+    }
+    //A damaged database file, or a spill that couldn't be written
+    catch (runtime_error& e)
+    {
+        answer = string("Failure!\n  ") + e.what() + "\n";
+    }
+
+    chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+
+    stringstream out;
+    out << answer << "(" << fixed << setprecision(3) << elapsed.count() << " ms)" << endl;
+    return out.str();
+}
+
+void Repl::serve(istream& in, ostream& out)
+{
+    string line;
+    while (getline(in, line))
+    {
+        if (line.find_first_not_of(" \t\r") == string::npos)
+        {
+            continue;
+        }
+
+        out << handle(line) << flush;
+    }
+}
+
+void Repl::serveSocket(const string& path)
+{
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server < 0)
+    {
+        throw runtime_error(string("Couldn't open a socket: ") + strerror(errno));
+    }
+
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path))
+    {
+        close(server);
+        throw runtime_error("Socket path is too long: " + path);
+    }
+    path.copy(address.sun_path, path.size());
+
+    unlink(path.c_str());
+    if (bind(server, (sockaddr*)&address, sizeof(address)) < 0 || listen(server, 8) < 0)
+    {
+        string reason = strerror(errno);
+        close(server);
+        throw runtime_error("Couldn't listen on " + path + ": " + reason);
+    }
+
+    while (true)
+    {
+        int client = accept(server, nullptr, nullptr);
+        if (client < 0)
+        {
+            continue;
+        }
+
+        if (clients >= MAX_CLIENTS)
+        {
+            static const string busy = "Failure!\n  Too many clients\n";
+            send(client, busy.data(), busy.size(), MSG_NOSIGNAL);
+            close(client);
+            continue;
+        }
+
+        clients++;
+        thread([this, client] {
+            serveClient(client);
+            clients--;
+        }).detach();
+    }
+}
+
+void Repl::serveClient(int client)
+{
+    //Split what comes in into lines and answer each one
+    string pending;
+    char buffer[4096];
+    ssize_t count;
+    while ((count = read(client, buffer, sizeof(buffer))) > 0)
+    {
+        pending.append(buffer, count);
+
+        size_t end;
+        while ((end = pending.find('\n')) != string::npos)
+        {
+            string line = pending.substr(0, end);
+            pending.erase(0, end + 1);
+
+            if (line.find_first_not_of(" \t\r") == string::npos)
+            {
+                continue;
+            }
+
+            //A client that has gone away gets EPIPE instead of SIGPIPE
+            //killing the server
+            string answer = handle(line);
+            size_t sent = 0;
+            while (sent < answer.size())
+            {
+                ssize_t written = send(client, answer.data() + sent, answer.size() - sent, MSG_NOSIGNAL);
+                if (written < 0)
+                {
+                    close(client);
+                    return;
+                }
+                sent += written;
+            }
+        }
+    }
+
+    close(client);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <mutex>
+#include <atomic>
+#include "Interpreter.h"
+#include "DatabaseFile.h"
+#include "Token.h"
+
+using namespace std;
+
+//Keeps an evaluated program around and answers requests against it, one per
+//line: queries ("p('a',x)?"), new facts ("p('a','b').") or new rules
+//("p(x,y) :- q(x,y)."). Every answer ends with how long the request took.
+//Queries read the latest snapshot without locking, updates take turns
+class Repl
+{
+private:
+    Interpreter& interpreter;
+    const DatabaseFile* file;
+    mutex writeLock;
+
+    //Connections being served right now. Past MAX_CLIENTS new ones are
+    //told so and closed rather than getting a thread each
+    atomic<int> clients;
+    static const int MAX_CLIENTS = 64;
+
+    void serveClient(int client);
+
+    static vector<Token> scan(const string& line);
+    static string describe(const Database& delta, const string& what);
+
+public:
+    //Given a saved database file, queries are answered from it and updates refused
+    Repl(Interpreter& interpreter, const DatabaseFile* file = nullptr);
+
+    string handle(const string& line);
+
+    //Reads requests until the input runs out
+    void serve(istream& in, ostream& out);
+
+    //Same thing over a Unix domain socket, every connection on its own thread.
+    //Throws runtime_error if it can't listen on the path
+    void serveSocket(const string& path);
+};
@@ -0,0 +1,127 @@
+#include "ResultCache.h"
+#include "BinaryIO.h"
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+static const char MAGIC[8] = { 'D', 'L', 'C', 'A', 'C', 'H', '1', '\0' };
+
+ResultCache::ResultCache(const string& directory) : directory(directory)
+{
+    if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST)
+    {
+        throw runtime_error("Couldn't create " + directory + ": " + strerror(errno));
+    }
+}
+
+string ResultCache::path(const string& key) const
+{
+    return directory + "/" + key;
+}
+
+//One 128 bit hash of everything the result depends on. At that width an
+//accidental collision between two keys isn't a practical concern
+string ResultCache::key(const string& rules, const vector<const Relation*>& inputs)
+{
+    Hash128 hash = hashText128(rules);
+
+    for (const Relation* input : inputs)
+    {
+        stringstream header;
+        //The column names too, the trace prints them
+        header << '\0' << input->getName() << '(';
+        for (const string& column : input->getSchemeNames())
+        {
+            header << column << ',';
+        }
+        header << ')' << input->size();
+        hash = hashText128(header.str(), hash);
+
+        for (const Tuple& tuple : *input)
+        {
+            for (const string& value : tuple)
+            {
+                //The length keeps ("ab", "c") apart from ("a", "bc")
+                hash = hashText128(to_string(value.size()) + ':' + value, hash);
+            }
+        }
+    }
+
+    stringstream ss;
+    ss << hex << setfill('0') << setw(16) << (unsigned long long)(hash >> 64) << setw(16) << (unsigned long long)hash;
+    return ss.str();
+}
+
+bool ResultCache::load(const string& key, Database& database, string& trace) const
+{
+    ifstream in(path(key), ios::binary);
+    if (!in.is_open())
+    {
+        return false;
+    }
+
+    char magic[sizeof(MAGIC)];
+    uint32_t count;
+    string cachedTrace;
+    if (!in.read(magic, sizeof(magic)) || memcmp(magic, MAGIC, sizeof(MAGIC)) != 0
+        || !getString(in, cachedTrace) || !getNumber(in, count))
+    {
+        return false;
+    }
+
+    vector<pair<string, vector<Tuple>>> outputs(count);
+    for (auto& output : outputs)
+    {
+        if (!getTuples(in, output.first, output.second) || database.count(output.first) == 0)
+        {
+            return false;
+        }
+    }
+
+    for (auto& output : outputs)
+    {
+        Relation& relation = database.getRelation(output.first);
+        for (Tuple& tuple : output.second)
+        {
+            relation.addTuple(move(tuple));
+        }
+    }
+
+    trace = cachedTrace;
+    return true;
+}
+
+void ResultCache::store(const string& key, const vector<const Relation*>& outputs, const string& trace) const
+{
+    string temporary = path(key) + ".tmp" + to_string(getpid());
+    ofstream out(temporary, ios::binary | ios::trunc);
+    if (!out.is_open())
+    {
+        throw runtime_error("Couldn't write " + temporary);
+    }
+
+    out.write(MAGIC, sizeof(MAGIC));
+    putString(out, trace);
+    putNumber(out, outputs.size());
+    for (const Relation* output : outputs)
+    {
+        putTuples(out, *output);
+    }
+
+    out.close();
+    if (!out || rename(temporary.c_str(), path(key).c_str()) != 0)
+    {
+        remove(temporary.c_str());
+        throw runtime_error("Couldn't write " + path(key));
+    }
+}
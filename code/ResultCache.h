@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "Database.h"
+#include "Relation.h"
+
+using namespace std;
+
+//A directory of SCC results from earlier runs, one file per result named by
+//the hash of the SCC's rules and the contents of every relation it reads.
+//The same rules over the same tuples always derive the same thing, so a
+//matching file can stand in for evaluating the SCC
+class ResultCache
+{
+private:
+    string directory;
+
+    string path(const string& key) const;
+
+public:
+    ResultCache(const string& directory);
+
+    static string key(const string& rules, const vector<const Relation*>& inputs);
+
+    //Adds the cached tuples to the database and sets the trace the SCC
+    //printed. Returns false, changing nothing, if there's no usable entry
+    bool load(const string& key, Database& database, string& trace) const;
+
+    //Written to a temporary file first, so readers never see half an entry
+    void store(const string& key, const vector<const Relation*>& outputs, const string& trace) const;
+};
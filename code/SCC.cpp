@@ -4,7 +4,7 @@
 #include <sstream>
 #include <vector>
 
-SCC::SCC(vector<int> ids, vector<Rule> rules) : vector<Rule>(rules) 
+SCC::SCC(vector<int> ids, vector<Rule> rules) : vector<Rule>(rules), ids(ids)
 {
     stringstream ss;
     int size = ids.size();
@@ -32,6 +32,11 @@ string SCC::getName() const
     return name;
 }
 
+vector<int> SCC::getIds() const
+{
+    return ids;
+}
+
 //If there are multiple rules or a single rule depends on itself,
 //then it is rule dependent (must run fix point)
 bool SCC::isRuleDependent()
@@ -9,10 +9,12 @@ class SCC : public vector<Rule>
 {
 private:
     string name;
+    vector<int> ids;
 public:
     SCC(vector<int> ids, vector<Rule> rules);
     bool isRuleDependent();
 
     string toString() const;
     string getName() const;
+    vector<int> getIds() const;
 };
\ No newline at end of file
@@ -13,13 +13,14 @@ public:
 
     string toString() const
     {
-        stringstream ss;
+        string out;
 
         for (unsigned int i = 0; i < size(); i++)
         {
-            ss << at(i) << " ";
+            out += at(i);
+            out += ' ';
         }
         
-        return ss.str();
+        return out;
     }
 };
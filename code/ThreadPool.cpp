@@ -0,0 +1,200 @@
+#include "ThreadPool.h"
+#include "Arena.h"
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <functional>
+
+using namespace std;
+
+//Which pool (and which of its queues) the current thread works for
+static thread_local const ThreadPool* currentPool = nullptr;
+static thread_local int currentIndex = 0;
+
+ThreadPool::ThreadPool(int size) : queued(0), stopping(false)
+{
+    int workerCount = max(0, size - 1);
+
+    //One queue per worker plus a shared one for outside threads
+    for (int i = 0; i <= workerCount; i++)
+    {
+        queues.push_back(unique_ptr<WorkQueue>(new WorkQueue()));
+    }
+
+    for (int i = 0; i < workerCount; i++)
+    {
+        workers.push_back(thread(&ThreadPool::work, this, i));
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    stopping = true;
+    wake(true);
+
+    for (thread& worker : workers)
+    {
+        worker.join();
+    }
+}
+
+int ThreadPool::size() const
+{
+    return workers.size() + 1;
+}
+
+int ThreadPool::queueIndex() const
+{
+    return currentPool == this ? currentIndex : workers.size();
+}
+
+void ThreadPool::wake(bool all)
+{
+    //Taking the lock keeps a sleeper from missing the change
+    {
+        lock_guard<mutex> guard(sleepLock);
+    }
+
+    if (all)
+    {
+        available.notify_all();
+    }
+    else
+    {
+        available.notify_one();
+    }
+}
+
+void ThreadPool::spawn(TaskGroup& group, function<void()> task)
+{
+    //The queues outlive the caller's arena
+    ArenaPause pause;
+    group.pending++;
+
+    function<void()> wrapped = [this, &group, task] {
+        try
+        {
+            task();
+        }
+        catch (...)
+        {
+            lock_guard<mutex> guard(group.lock);
+            if (!group.error)
+            {
+                group.error = current_exception();
+            }
+        }
+
+        if (--group.pending == 0)
+        {
+            wake(true);
+        }
+    };
+
+    //No workers, just do it now
+    if (workers.empty())
+    {
+        wrapped();
+        return;
+    }
+
+    WorkQueue& queue = *queues.at(queueIndex());
+    {
+        lock_guard<mutex> guard(queue.lock);
+        queue.tasks.push_back(wrapped);
+    }
+
+    queued++;
+    wake(false);
+}
+
+//Runs a task from our own queue, or steals one. Returns false if there was nothing
+bool ThreadPool::runOne()
+{
+    int count = queues.size();
+    int own = queueIndex();
+    function<void()> task;
+
+    for (int i = 0; i < count && !task; i++)
+    {
+        int index = (own + i) % count;
+        WorkQueue& queue = *queues.at(index);
+        lock_guard<mutex> guard(queue.lock);
+
+        if (queue.tasks.empty())
+        {
+            continue;
+        }
+
+        if (index == own)
+        {
+            task = move(queue.tasks.back());
+            queue.tasks.pop_back();
+        }
+        else
+        {
+            task = move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+    }
+
+    if (!task)
+    {
+        return false;
+    }
+
+    //A task picked up while waiting isn't part of whatever the waiting
+    //thread's arena is for
+    queued--;
+    ArenaPause pause;
+    task();
+    return true;
+}
+
+void ThreadPool::wait(TaskGroup& group)
+{
+    while (!group.done())
+    {
+        if (!runOne())
+        {
+            unique_lock<mutex> guard(sleepLock);
+            available.wait_for(guard, chrono::milliseconds(1), [&] { return group.done() || queued > 0; });
+        }
+    }
+
+    //Hand the first failure back to the caller
+    if (group.error)
+    {
+        exception_ptr e = group.error;
+        group.error = nullptr;
+        rethrow_exception(e);
+    }
+}
+
+void ThreadPool::run(int count, function<void(int)> task)
+{
+    TaskGroup group;
+
+    for (int i = 0; i < count; i++)
+    {
+        spawn(group, [&task, i] { task(i); });
+    }
+
+    wait(group);
+}
+
+void ThreadPool::work(int index)
+{
+    currentPool = this;
+    currentIndex = index;
+
+    while (!stopping)
+    {
+        if (!runOne())
+        {
+            unique_lock<mutex> guard(sleepLock);
+            available.wait(guard, [this] { return stopping || queued > 0; });
+        }
+    }
+}
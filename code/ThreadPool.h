@@ -0,0 +1,73 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+
+using namespace std;
+
+//Tasks spawned together that someone waits on as a unit
+class TaskGroup
+{
+private:
+    atomic<int> pending;
+    mutex lock;
+    exception_ptr error;
+
+    friend class ThreadPool;
+
+public:
+    TaskGroup() : pending(0) {}
+
+    bool done() const { return pending == 0; }
+};
+
+//Work stealing pool. Every worker owns a queue it pushes and pops at the back,
+//idle workers steal from the front of the others. Threads waiting on a group
+//run tasks while they wait, so tasks can spawn and wait on their own tasks
+class ThreadPool
+{
+private:
+    struct WorkQueue
+    {
+        mutex lock;
+        deque<function<void()>> tasks;
+    };
+
+    vector<thread> workers;
+    vector<unique_ptr<WorkQueue>> queues;
+
+    atomic<int> queued;
+    atomic<bool> stopping;
+
+    mutex sleepLock;
+    condition_variable available;
+
+    void work(int index);
+    int queueIndex() const;
+    bool runOne();
+    void wake(bool all);
+
+public:
+    //A pool of size 1 (or less) has no workers and runs everything inline.
+    //Otherwise it starts size - 1 workers, the waiting thread is the last one
+    ThreadPool(int size);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void spawn(TaskGroup& group, function<void()> task);
+    void wait(TaskGroup& group);
+
+    //Runs task(0) through task(count - 1) and blocks until they are all done
+    void run(int count, function<void(int)> task);
+
+    int size() const;
+};
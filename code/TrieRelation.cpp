@@ -0,0 +1,337 @@
+#include "TrieRelation.h"
+#include "Query.h"
+#include "Arena.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <algorithm>
+
+using namespace std;
+
+TrieRelation::TrieRelation(const Relation& relation)
+    : name(relation.getName()), scheme(relation.getSchemeNames()), rows(relation.size())
+{
+    set<string> distinct;
+    for (const Tuple& tuple : relation)
+    {
+        distinct.insert(tuple.begin(), tuple.end());
+    }
+    dictionary = make_shared<const vector<string>>(distinct.begin(), distinct.end());
+
+    for (unsigned i = 0; i < scheme.size(); i++)
+    {
+        order.push_back(i);
+    }
+
+    vector<vector<uint32_t>> ids;
+    ids.reserve(rows);
+    for (const Tuple& tuple : relation)
+    {
+        vector<uint32_t> row;
+        for (const string& value : tuple)
+        {
+            row.push_back(find(value));
+        }
+        ids.push_back(row);
+    }
+
+    build(ids);
+}
+
+//A copy with its levels in another column order, sharing the dictionary
+TrieRelation::TrieRelation(const TrieRelation& trie, const vector<int>& order)
+    : name(trie.name), scheme(trie.scheme), dictionary(trie.dictionary), rows(trie.rows), order(order)
+{
+    vector<vector<uint32_t>> ids;
+    ids.reserve(rows);
+    trie.lookup(vector<uint32_t>(), [&](const vector<uint32_t>& row) {
+        vector<uint32_t> reordered;
+        for (int column : order)
+        {
+            reordered.push_back(row[column]);
+        }
+        ids.push_back(reordered);
+    });
+
+    build(ids);
+}
+
+//Adds the rows one at a time in sorted order. A row only adds nodes from the
+//first column where it differs from the row before it
+void TrieRelation::build(vector<vector<uint32_t>> ids)
+{
+    sort(ids.begin(), ids.end());
+
+    values.assign(order.size(), vector<uint32_t>());
+    children.assign(order.size(), vector<uint32_t>());
+
+    for (size_t r = 0; r < ids.size(); r++)
+    {
+        unsigned level = 0;
+        while (r > 0 && level < order.size() && ids[r][level] == ids[r - 1][level])
+        {
+            level++;
+        }
+
+        for (; level < order.size(); level++)
+        {
+            if (level + 1 < order.size())
+            {
+                children[level].push_back(values[level + 1].size());
+            }
+            values[level].push_back(ids[r][level]);
+        }
+    }
+
+    for (auto& level : values)
+    {
+        level.shrink_to_fit();
+    }
+    for (auto& level : children)
+    {
+        level.shrink_to_fit();
+    }
+}
+
+long TrieRelation::find(const string& value) const
+{
+    auto it = lower_bound(dictionary->begin(), dictionary->end(), value);
+    if (it == dictionary->end() || *it != value)
+    {
+        return -1;
+    }
+
+    return it - dictionary->begin();
+}
+
+//Bound columns go first in scheme order, then the rest
+const TrieRelation& TrieRelation::index(const vector<int>& order) const
+{
+    if (order == this->order)
+    {
+        return *this;
+    }
+
+    //Built in the middle of a rule, but kept for the rest of the run
+    ArenaPause pause;
+    lock_guard<mutex> guard(indexLock);
+    unique_ptr<TrieRelation>& index = indexes[order];
+    if (index == nullptr)
+    {
+        index.reset(new TrieRelation(*this, order));
+    }
+
+    return *index;
+}
+
+void TrieRelation::collect(unsigned level, size_t node, vector<uint32_t>& row,
+                           const function<void(const vector<uint32_t>&)>& emit) const
+{
+    row[order[level]] = values[level][node];
+
+    if (level + 1 == order.size())
+    {
+        emit(row);
+        return;
+    }
+
+    size_t begin = children[level][node];
+    size_t end = node + 1 < children[level].size() ? children[level][node + 1] : values[level + 1].size();
+    for (size_t child = begin; child < end; child++)
+    {
+        collect(level + 1, child, row, emit);
+    }
+}
+
+void TrieRelation::lookup(const vector<uint32_t>& prefix, const function<void(const vector<uint32_t>&)>& emit) const
+{
+    if (rows == 0 || order.empty())
+    {
+        return;
+    }
+
+    vector<uint32_t> row(order.size());
+    size_t begin = 0;
+    size_t end = values[0].size();
+    for (unsigned level = 0; level < prefix.size(); level++)
+    {
+        auto first = values[level].begin() + begin;
+        auto last = values[level].begin() + end;
+        auto it = lower_bound(first, last, prefix[level]);
+        if (it == last || *it != prefix[level])
+        {
+            return;
+        }
+
+        size_t node = it - values[level].begin();
+        if (level + 1 == prefix.size())
+        {
+            collect(level, node, row, emit);
+            return;
+        }
+
+        row[order[level]] = prefix[level];
+        begin = children[level][node];
+        end = node + 1 < children[level].size() ? children[level][node + 1] : values[level + 1].size();
+    }
+
+    for (size_t node = begin; node < end; node++)
+    {
+        collect(0, node, row, emit);
+    }
+}
+
+Tuple TrieRelation::decode(const vector<uint32_t>& row) const
+{
+    vector<string> decoded;
+    decoded.reserve(row.size());
+    for (uint32_t id : row)
+    {
+        decoded.push_back((*dictionary)[id]);
+    }
+
+    return Tuple(move(decoded));
+}
+
+Relation TrieRelation::select(const Predicate& predicate, const Relation* joinWith) const
+{
+    Relation result(name, scheme);
+    Query query(predicate.getParams());
+
+    //What's bound for every lookup: the constants, then the variables shared
+    //with the other side of the join
+    map<int, uint32_t> constants;
+    for (int index : query.getConstants())
+    {
+        long id = find(query.at(index).value);
+        if (id < 0)
+        {
+            return result;
+        }
+        constants[index] = id;
+    }
+
+    vector<vector<int>> repeated;
+    map<int, int> shared;
+    vector<string> joinNames = joinWith != nullptr ? joinWith->getSchemeNames() : vector<string>();
+    for (auto& variable : query.getVariables())
+    {
+        if (variable.second.size() > 1)
+        {
+            repeated.push_back(variable.second);
+        }
+
+        auto it = std::find(joinNames.begin(), joinNames.end(), variable.first);
+        if (it != joinNames.end())
+        {
+            shared[variable.second.at(0)] = it - joinNames.begin();
+        }
+    }
+
+    vector<int> bound;
+    for (unsigned i = 0; i < scheme.size(); i++)
+    {
+        if (constants.count(i) > 0 || shared.count(i) > 0)
+        {
+            bound.push_back(i);
+        }
+    }
+
+    vector<int> lookupOrder = bound;
+    for (unsigned i = 0; i < scheme.size(); i++)
+    {
+        if (std::find(bound.begin(), bound.end(), (int)i) == bound.end())
+        {
+            lookupOrder.push_back(i);
+        }
+    }
+    const TrieRelation& trie = index(lookupOrder);
+
+    //One lookup per distinct prefix
+    set<vector<uint32_t>> prefixes;
+    if (shared.empty())
+    {
+        vector<uint32_t> prefix;
+        for (int column : bound)
+        {
+            prefix.push_back(constants.at(column));
+        }
+        prefixes.insert(prefix);
+    }
+    else
+    {
+        for (const Tuple& tuple : *joinWith)
+        {
+            vector<uint32_t> prefix;
+            for (int column : bound)
+            {
+                long id = constants.count(column) > 0 ? constants.at(column) : find(tuple[shared.at(column)]);
+                if (id < 0)
+                {
+                    break;
+                }
+                prefix.push_back(id);
+            }
+
+            if (prefix.size() == bound.size())
+            {
+                prefixes.insert(prefix);
+            }
+        }
+    }
+
+    for (const vector<uint32_t>& prefix : prefixes)
+    {
+        trie.lookup(prefix, [&](const vector<uint32_t>& row) {
+            for (auto& positions : repeated)
+            {
+                for (int position : positions)
+                {
+                    if (row[position] != row[positions.at(0)])
+                    {
+                        return;
+                    }
+                }
+            }
+
+            result.addTuple(decode(row));
+        });
+    }
+
+    return result;
+}
+
+Relation TrieRelation::decode() const
+{
+    //The rows come out in order, so each one goes on the end
+    Relation result(name, scheme);
+    lookup(vector<uint32_t>(), [&](const vector<uint32_t>& row) {
+        result.tuples.emplace_hint(result.tuples.end(), decode(row));
+    });
+    return result;
+}
+
+size_t TrieRelation::size() const
+{
+    return rows;
+}
+
+size_t TrieRelation::bytes() const
+{
+    size_t total = sizeof(*this);
+    for (const string& value : *dictionary)
+    {
+        total += sizeof(string) + (value.capacity() > 15 ? value.capacity() + 1 : 0);
+    }
+    for (auto& level : values)
+    {
+        total += level.capacity() * sizeof(uint32_t);
+    }
+    for (auto& level : children)
+    {
+        total += level.capacity() * sizeof(uint32_t);
+    }
+
+    return total;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+#include <functional>
+#include "Relation.h"
+#include "Predicate.h"
+#include "Scheme.h"
+#include "FrozenRelation.h"
+
+using namespace std;
+
+//A read only copy of a relation stored as a trie, one level per column, so
+//rows that start the same share the nodes for their common prefix. Values
+//are ids into a sorted dictionary. Each level is a sorted array of values
+//with, for every node, where its children start on the next level, so the
+//rows under a prefix are found with a binary search per column.
+//
+//The columns can go in any order. Lookups that bind columns other than the
+//leading ones get a copy of the trie with those columns first, built the
+//first time it's needed and kept as an index
+class TrieRelation : public FrozenRelation
+{
+private:
+    string name;
+    Scheme scheme;
+    shared_ptr<const vector<string>> dictionary;
+    size_t rows;
+
+    //Scheme positions in the order the levels go
+    vector<int> order;
+    vector<vector<uint32_t>> values;
+    vector<vector<uint32_t>> children;
+
+    mutable mutex indexLock;
+    mutable map<vector<int>, unique_ptr<TrieRelation>> indexes;
+
+    TrieRelation(const TrieRelation& trie, const vector<int>& order);
+    void build(vector<vector<uint32_t>> ids);
+
+    long find(const string& value) const;
+    const TrieRelation& index(const vector<int>& order) const;
+
+    //Passes on every row under the node at the given level and position, as
+    //ids in scheme order
+    void collect(unsigned level, size_t node, vector<uint32_t>& row,
+                 const function<void(const vector<uint32_t>&)>& emit) const;
+
+    //Every row starting with the prefix, in this trie's column order
+    void lookup(const vector<uint32_t>& prefix, const function<void(const vector<uint32_t>&)>& emit) const;
+
+    Tuple decode(const vector<uint32_t>& row) const;
+
+public:
+    TrieRelation(const Relation& relation);
+
+    //Looks up the rows for each distinct key of joinWith
+    Relation select(const Predicate& predicate, const Relation* joinWith = nullptr) const override;
+
+    Relation decode() const override;
+
+    size_t size() const override;
+
+    //The dictionary and this trie's arrays, the indexes built from it not counted
+    size_t bytes() const override;
+};
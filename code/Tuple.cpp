@@ -1,21 +1,24 @@
 #include <vector>
 #include <string>
 #include "Tuple.h"
-#include <sstream>
 
 using namespace std;
 
 string Tuple::toString(const Scheme& scheme) const
 {
-    stringstream out;
+    string out;
+    appendTo(out, scheme);
+    return out;
+}
+
+void Tuple::appendTo(string& out, const Scheme& scheme) const
+{
     for (unsigned i = 0; i < size(); i++) {
         if (i > 0) {
-	        out << ", ";
+            out += ", ";
         }
-        const string& name = scheme.at(i);
-        const string& value = at(i);
-        out << name << "=" << value;
-        
+        out += scheme.at(i);
+        out += '=';
+        out += at(i);
     }
-    return out.str();
-}
\ No newline at end of file
+}
@@ -2,6 +2,7 @@
 
 #include <vector>
 #include <string>
+#include <functional>
 #include "Scheme.h"
 
 using namespace std;
@@ -12,4 +13,23 @@ public:
 	Tuple(vector<string> values) : vector<string>(values) {}
 
     string toString(const Scheme& scheme) const;
+
+    //Adds the toString text to the end of out
+    void appendTo(string& out, const Scheme& scheme) const;
+};
+
+
+//Hashes every value of a tuple, for the unordered containers
+struct TupleHash
+{
+    size_t operator()(const Tuple& tuple) const
+    {
+        size_t seed = tuple.size();
+        for (const string& value : tuple)
+        {
+            seed ^= hash<string>()(value) + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+        }
+
+        return seed;
+    }
 };
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <utility>
+#include <functional>
+#include "Tuple.h"
+
+using namespace std;
+
+//Compares the key columns of two tuples (left[leftColumns[i]] == right[rightColumns[i]])
+typedef bool (*KeyMatcher)(const Tuple& left, const Tuple& right, const int* leftColumns, const int* rightColumns);
+
+//Fixed width version, the comparisons get fully unrolled by the compiler
+template<size_t... I>
+inline bool matchFixedKey(const Tuple& left, const Tuple& right, const int* leftColumns, const int* rightColumns, index_sequence<I...>)
+{
+    return (true && ... && (left[leftColumns[I]] == right[rightColumns[I]]));
+}
+
+template<unsigned N>
+bool matchKey(const Tuple& left, const Tuple& right, const int* leftColumns, const int* rightColumns)
+{
+    return matchFixedKey(left, right, leftColumns, rightColumns, make_index_sequence<N>());
+}
+
+//The same comparison as a type, so a loop handed one gets it inlined
+template<unsigned N>
+struct FixedKeyMatcher
+{
+    const int* leftColumns;
+    const int* rightColumns;
+
+    bool operator()(const Tuple& left, const Tuple& right) const
+    {
+        return matchFixedKey(left, right, leftColumns, rightColumns, make_index_sequence<N>());
+    }
+};
+
+struct WideKeyMatcher
+{
+    const vector<int>* leftColumns;
+    const vector<int>* rightColumns;
+
+    bool operator()(const Tuple& left, const Tuple& right) const
+    {
+        for (unsigned i = 0; i < leftColumns->size(); i++)
+        {
+            if (left[(*leftColumns)[i]] != right[(*rightColumns)[i]])
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+};
+
+class TupleKey
+{
+private:
+    vector<int> leftColumns;
+    vector<int> rightColumns;
+    KeyMatcher matcher;
+
+public:
+    TupleKey() : TupleKey(vector<int>(), vector<int>()) {}
+    TupleKey(vector<int> leftColumns, vector<int> rightColumns);
+
+    bool matches(const Tuple& left, const Tuple& right) const
+    {
+        if (matcher != nullptr)
+        {
+            return matcher(left, right, leftColumns.data(), rightColumns.data());
+        }
+
+        return matchesWide(left, right);
+    }
+
+    unsigned size() const
+    {
+        return leftColumns.size();
+    }
+
+    //Calls body with a matcher for this key's width, picked once here instead
+    //of through matches' function pointer on every comparison. Hot loops go
+    //inside body so they get compiled once per width
+    template<typename Body>
+    auto dispatch(Body&& body) const
+    {
+        const int* left = leftColumns.data();
+        const int* right = rightColumns.data();
+        switch (leftColumns.size())
+        {
+            case 1: return body(FixedKeyMatcher<1>{left, right});
+            case 2: return body(FixedKeyMatcher<2>{left, right});
+            case 3: return body(FixedKeyMatcher<3>{left, right});
+            case 4: return body(FixedKeyMatcher<4>{left, right});
+            default: return body(WideKeyMatcher{&leftColumns, &rightColumns});
+        }
+    }
+
+    size_t hashLeft(const Tuple& tuple) const
+    {
+        return hashColumns(tuple, leftColumns);
+    }
+
+    size_t hashRight(const Tuple& tuple) const
+    {
+        return hashColumns(tuple, rightColumns);
+    }
+
+    static size_t hashColumns(const Tuple& tuple, const vector<int>& columns)
+    {
+        size_t seed = columns.size();
+        for (int column : columns)
+        {
+            seed ^= hash<string>()(tuple[column]) + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+        }
+
+        return seed;
+    }
+
+    const vector<int>& getLeftColumns() const
+    {
+        return leftColumns;
+    }
+
+    const vector<int>& getRightColumns() const
+    {
+        return rightColumns;
+    }
+
+private:
+    //Generic fallback for keys wider than the specialized ones
+    bool matchesWide(const Tuple& left, const Tuple& right) const
+    {
+        for (unsigned i = 0; i < leftColumns.size(); i++)
+        {
+            if (left[leftColumns[i]] != right[rightColumns[i]])
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+};
+
+//Picks the unrolled matcher for the common key widths (0 through 8)
+inline TupleKey::TupleKey(vector<int> _leftColumns, vector<int> _rightColumns)
+    : leftColumns(_leftColumns), rightColumns(_rightColumns), matcher(nullptr)
+{
+    switch (leftColumns.size())
+    {
+        case 0: matcher = matchKey<0>; break;
+        case 1: matcher = matchKey<1>; break;
+        case 2: matcher = matchKey<2>; break;
+        case 3: matcher = matchKey<3>; break;
+        case 4: matcher = matchKey<4>; break;
+        case 5: matcher = matchKey<5>; break;
+        case 6: matcher = matchKey<6>; break;
+        case 7: matcher = matchKey<7>; break;
+        case 8: matcher = matchKey<8>; break;
+        default: matcher = nullptr; break;
+    }
+}
+
+//Copies the given columns of a tuple into a new tuple, sized once up front
+inline Tuple copyColumns(const Tuple& tuple, const vector<int>& columns)
+{
+    vector<string> values;
+    values.reserve(columns.size());
+    for (int column : columns)
+    {
+        values.push_back(tuple[column]);
+    }
+
+    return Tuple(move(values));
+}
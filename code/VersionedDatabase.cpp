@@ -0,0 +1,36 @@
+#include "VersionedDatabase.h"
+#include <map>
+#include <set>
+#include <string>
+#include <memory>
+
+using namespace std;
+
+shared_ptr<const Snapshot> VersionedDatabase::read() const
+{
+    return atomic_load(&current);
+}
+
+void VersionedDatabase::publish(const Database& database, const Database& added, const Database& removed)
+{
+    shared_ptr<const Snapshot> last = read();
+    shared_ptr<Snapshot> next = make_shared<Snapshot>();
+    next->epoch = last->epoch + 1;
+
+    for (auto& pair : database)
+    {
+        auto previous = last->relations.find(pair.first);
+        if (previous == last->relations.end())
+        {
+            next->relations.emplace(pair.first, LayeredRelation(make_shared<const Relation>(pair.second)));
+            continue;
+        }
+
+        auto adds = added.find(pair.first);
+        auto removes = removed.find(pair.first);
+        next->relations.emplace(pair.first, previous->second.withChanges(adds == added.end() ? nullptr : &adds->second,
+                                                                        removes == removed.end() ? nullptr : &removes->second));
+    }
+
+    atomic_store(&current, shared_ptr<const Snapshot>(next));
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <map>
+#include <set>
+#include <string>
+#include <memory>
+#include "Database.h"
+#include "Relation.h"
+#include "LayeredRelation.h"
+
+using namespace std;
+
+//A read only version of the database. Its relations share their tuples with
+//the versions before, each version only adds a layer with what changed
+struct Snapshot
+{
+    Snapshot() : epoch(0) {}
+
+    long epoch;
+    map<string, LayeredRelation> relations;
+};
+
+//Copy on write versions of the database for lock free readers. The one writer
+//publishes a new snapshot after every update, readers grab whichever one is
+//current and keep it as long as they need; old ones go away with their last reader
+class VersionedDatabase
+{
+private:
+    shared_ptr<const Snapshot> current;
+
+public:
+    VersionedDatabase() : current(make_shared<const Snapshot>()) {}
+
+    shared_ptr<const Snapshot> read() const;
+
+    //Layers the tuples added to and removed from the writer's database on top
+    //of the last snapshot's relations. Only relations the last snapshot
+    //doesn't have get copied out of the database
+    void publish(const Database& database, const Database& added, const Database& removed);
+};
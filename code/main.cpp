@@ -1,6 +1,10 @@
 #include <fstream>
 #include <iostream>
 #include <vector>
+#include <stdexcept>
+#include <memory>
+#include <thread>
+#include <algorithm>
 #include "Token.h"
 #include "Scanner.h"
 #include "Parser.h"
@@ -12,6 +16,9 @@
 #include "Interpreter.h"
 #include "Node.h"
 #include "Graph.h"
+#include "Options.h"
+#include "Repl.h"
+#include "DatabaseFile.h"
 
 using namespace std;
 
@@ -19,25 +26,368 @@ string getInput(string fileName);
 vector<Token> scanTokens(string input, bool doCout = false);
 DatalogProgram parseTokens(vector<Token>);
 DatalogProgram parseProgram(string fileName, bool p1Cout = false, bool p2Cout = false);
+vector<Predicate> parseFacts(string fileName);
 void test();
+Options parseOptions(int argc, char* argv[], string& fileName);
+void serve(Repl&& repl, const Options& options);
 
 int main(int argc, char* argv[]) 
 {
+    //cout keeps its own buffer instead of going through stdio a call at a time
+    ios::sync_with_stdio(false);
+
     string fileName = "test.txt";
-    if (argc > 1)
-    {
-        fileName = argv[1];
-    }
+    Options options = parseOptions(argc, argv, fileName);
 
     DatalogProgram datalogProgram = parseProgram(fileName);
     
-    Interpreter interpreter(datalogProgram);
+    Interpreter interpreter(datalogProgram, options);
+
+    //A saved database answers the queries without evaluating anything
+    if (!options.loadFile.empty())
+    {
+        unique_ptr<DatabaseFile> file;
+        try
+        {
+            file = make_unique<DatabaseFile>(options.loadFile);
+            interpreter.runFromFile(*file);
+        }
+        catch (exception& e)
+        {
+            cout << flush;
+            cerr << "Load failed: " << e.what() << endl;
+            exit(1);
+        }
+
+        if (options.repl)
+        {
+            serve(Repl(interpreter, file.get()), options);
+        }
+
+        return 0;
+    }
+
+    //Spilling to disk under --memory-limit can run out of room or files
+    try
+    {
+        interpreter.run();
+    }
+    catch (runtime_error& e)
+    {
+        cout << flush;
+        cerr << "Evaluation failed: " << e.what() << endl;
+        exit(1);
+    }
+
+    try
+    {
+        if (!options.insertFile.empty())
+        {
+            interpreter.runInsert(parseFacts(options.insertFile));
+        }
+
+        if (!options.retractFile.empty())
+        {
+            interpreter.runRetract(parseFacts(options.retractFile));
+        }
+    }
+    catch (invalid_argument& e)
+    {
+        cout << "Bad facts: " << e.what() << endl;
+        exit(0);
+    }
+
+    if (!options.saveFile.empty())
+    {
+        try
+        {
+            interpreter.saveDatabase(options.saveFile);
+        }
+        catch (runtime_error& e)
+        {
+            cout << flush;
+            cerr << "Save failed: " << e.what() << endl;
+            exit(1);
+        }
+    }
 
-    interpreter.run();
+    if (options.repl)
+    {
+        serve(Repl(interpreter), options);
+    }
 
     //test();
 }
 
+void serve(Repl&& repl, const Options& options)
+{
+    if (options.socketPath.empty())
+    {
+        repl.serve(cin, cout);
+    }
+    else
+    {
+        try
+        {
+            repl.serveSocket(options.socketPath);
+        }
+        catch (runtime_error& e)
+        {
+            cout << flush;
+            cerr << "Serving failed: " << e.what() << endl;
+            exit(1);
+        }
+    }
+}
+
+//A byte count with an optional K, M or G after it
+size_t parseBytes(const string& text)
+{
+    size_t end = 0;
+    double value = 0;
+    try
+    {
+        value = stod(text, &end);
+    }
+    catch (const exception&)
+    {
+        end = 0;
+    }
+
+    string unit = text.substr(end);
+    size_t scale = unit == "K" ? 1 << 10 : unit == "M" ? 1 << 20 : unit == "G" ? 1 << 30 : 1;
+    if (end == 0 || value < 0 || (scale == 1 && !unit.empty()))
+    {
+        cout << "Bad size " << text << endl;
+        exit(0);
+    }
+
+    return value * scale;
+}
+
+//A thread count between 1 and a few per core. Every thread but one is a
+//worker started up front, so a huge count would just thrash
+int parseThreads(const string& text)
+{
+    int cores = max(1u, thread::hardware_concurrency());
+    int limit = max(64, 8 * cores);
+
+    size_t end = 0;
+    int threads = 0;
+    try
+    {
+        threads = stoi(text, &end);
+    }
+    catch (const exception&)
+    {
+        end = 0;
+    }
+
+    if (end == 0 || end != text.size() || threads < 1)
+    {
+        cout << "Bad thread count " << text << endl;
+        exit(0);
+    }
+
+    if (threads > limit)
+    {
+        cout << "Can't use more than " << limit << " threads" << endl;
+        exit(0);
+    }
+
+    return threads;
+}
+
+//Usage: lab5 [file] [--threads N] [--jacobi] [--magic] [--prune] [--release] [--insert facts] [--retract facts]
+//                  [--repl] [--socket path] [--save db] [--load db]
+//                  [--checkpoint file] [--checkpoint-interval seconds] [--resume] [--cache dir]
+//                  [--columnar] [--trie] [--memory-limit bytes[K|M|G]] [--spill-dir dir]
+//                  [--memory-report] [--arena] [--output trace|queries|counts]
+Options parseOptions(int argc, char* argv[], string& fileName)
+{
+    Options options;
+
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+
+        if (arg == "--threads" && i + 1 < argc)
+        {
+            options.threads = parseThreads(argv[++i]);
+        }
+        else if (arg == "--jacobi")
+        {
+            options.jacobi = true;
+        }
+        else if (arg == "--magic")
+        {
+            options.magic = true;
+        }
+        else if (arg == "--prune")
+        {
+            options.prune = true;
+        }
+        else if (arg == "--release")
+        {
+            options.release = true;
+        }
+        else if (arg == "--insert" && i + 1 < argc)
+        {
+            options.insertFile = argv[++i];
+        }
+        else if (arg == "--retract" && i + 1 < argc)
+        {
+            options.retractFile = argv[++i];
+        }
+        else if (arg == "--repl")
+        {
+            options.repl = true;
+        }
+        else if (arg == "--socket" && i + 1 < argc)
+        {
+            options.repl = true;
+            options.socketPath = argv[++i];
+        }
+        else if (arg == "--save" && i + 1 < argc)
+        {
+            options.saveFile = argv[++i];
+        }
+        else if (arg == "--load" && i + 1 < argc)
+        {
+            options.loadFile = argv[++i];
+        }
+        else if (arg == "--checkpoint" && i + 1 < argc)
+        {
+            options.checkpointFile = argv[++i];
+        }
+        else if (arg == "--checkpoint-interval" && i + 1 < argc)
+        {
+            options.checkpointInterval = max(0.0, atof(argv[++i]));
+        }
+        else if (arg == "--resume")
+        {
+            options.resume = true;
+        }
+        else if (arg == "--cache" && i + 1 < argc)
+        {
+            options.cacheDir = argv[++i];
+        }
+        else if (arg == "--columnar")
+        {
+            options.columnar = true;
+        }
+        else if (arg == "--trie")
+        {
+            options.trie = true;
+        }
+        else if (arg == "--memory-limit" && i + 1 < argc)
+        {
+            options.memoryLimit = parseBytes(argv[++i]);
+        }
+        else if (arg == "--spill-dir" && i + 1 < argc)
+        {
+            options.spillDir = argv[++i];
+        }
+        else if (arg == "--memory-report")
+        {
+            options.memoryReport = true;
+        }
+        else if (arg == "--arena")
+        {
+            options.arena = true;
+        }
+        else if (arg == "--output" && i + 1 < argc)
+        {
+            string level = argv[++i];
+            if (level == "trace")
+            {
+                options.verbosity = Verbosity::Trace;
+            }
+            else if (level == "queries")
+            {
+                options.verbosity = Verbosity::Queries;
+            }
+            else if (level == "counts")
+            {
+                options.verbosity = Verbosity::Counts;
+            }
+            else
+            {
+                cout << "Bad output level " << level << endl;
+                exit(0);
+            }
+        }
+        else if (arg.rfind("--", 0) == 0)
+        {
+            cout << "Bad option " << arg << endl;
+            exit(0);
+        }
+        else
+        {
+            fileName = arg;
+        }
+    }
+
+    //The released relations would be needed to derive the new facts' consequences
+    if (options.release && (!options.insertFile.empty() || !options.retractFile.empty()))
+    {
+        cout << "Can't use --release with --insert or --retract" << endl;
+        exit(0);
+    }
+
+    //Requests are answered from the plain relations, so all of them have to be there
+    if (options.repl && (options.magic || options.prune || options.release))
+    {
+        cout << "Can't use --repl with --magic, --prune or --release" << endl;
+        exit(0);
+    }
+
+    //A saved database has to hold every relation in full to answer later queries
+    if (!options.saveFile.empty() && (options.magic || options.prune || options.release))
+    {
+        cout << "Can't use --save with --magic, --prune or --release" << endl;
+        exit(0);
+    }
+
+    //A loaded database only answers queries, nothing gets evaluated. Magic
+    //sets would ask it for adorned relations it doesn't have
+    if (!options.loadFile.empty() && (options.magic || !options.insertFile.empty() || !options.retractFile.empty()
+        || !options.saveFile.empty()))
+    {
+        cout << "Can't use --load with --magic, --insert, --retract or --save" << endl;
+        exit(0);
+    }
+
+    if (options.columnar && options.trie)
+    {
+        cout << "Can't use --columnar with --trie" << endl;
+        exit(0);
+    }
+
+    //Compressed relations are read only and only the rules and queries read them
+    if ((options.columnar || options.trie) && (options.repl || !options.insertFile.empty() || !options.retractFile.empty()
+        || !options.saveFile.empty()))
+    {
+        cout << "Can't use --columnar or --trie with --repl, --insert, --retract or --save" << endl;
+        exit(0);
+    }
+
+    //Arena memory only goes back when a rule is done, so what a rule spills
+    //to stay under the limit wouldn't actually be freed
+    if (options.arena && options.memoryLimit > 0)
+    {
+        cout << "Can't use --arena with --memory-limit" << endl;
+        exit(0);
+    }
+
+    if (options.resume && options.checkpointFile.empty())
+    {
+        cout << "Can't use --resume without --checkpoint" << endl;
+        exit(0);
+    }
+
+    return options;
+}
 
 void test()
 {   
@@ -119,6 +469,21 @@ DatalogProgram parseProgram(string fileName, bool p1Cout, bool p2Cout)
     return program;
 }
 
+vector<Predicate> parseFacts(string fileName)
+{
+    vector<Token> tokens = scanTokens(getInput(fileName));
+
+    Parser p = Parser(tokens);
+    if (!p.parseFacts())
+    {
+        cout << "Failure!" << endl;
+        cout << "  " << p.getErrorToken().toString() << endl;
+        exit(0);
+    }
+
+    return p.getDatalogProgram().getFacts();
+}
+
 vector<Token> scanTokens(string input, bool doCout)
 {
     Scanner s(input);
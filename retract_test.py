@@ -0,0 +1,49 @@
+# Differential test for --retract: taking facts back from an evaluated
+# program has to answer the queries the same as a fresh run of the program
+# without those facts. Every passoff input gets a few random retractions.
+# Usage: python3 retract_test.py [./lab5]
+
+import glob, os, random, re, subprocess, sys, tempfile
+
+binary = sys.argv[1] if len(sys.argv) > 1 else "./lab5"
+work = tempfile.mkdtemp()
+full = os.path.join(work, "full.txt")
+fresh = os.path.join(work, "fresh.txt")
+retracted = os.path.join(work, "retract.txt")
+
+def queries(output):
+    # The answers after the last evaluation, the retraction's
+    return output[output.rfind("Query Evaluation"):]
+
+def run(*args):
+    return subprocess.run([binary] + list(args), capture_output=True, text=True).stdout
+
+random.seed(36)
+inputs = sorted(glob.glob("project5-passoff/*/input*.txt") + glob.glob("project5-tests/in*.txt"))
+checked = 0
+failed = 0
+for name in inputs:
+    program = open(name).read()
+    section = re.search(r"Facts\s*:(.*?)Rules\s*:", program, re.S)
+    facts = re.findall(r"[A-Za-z][A-Za-z0-9]*\s*\([^)]*\)\s*\.", section.group(1))
+    if not facts:
+        continue
+
+    # One fact at a time finds the deletes that shouldn't cascade, a third
+    # of them the ones that should
+    for taken in [[random.choice(facts)], [fact for fact in facts if random.random() < 0.3]]:
+        kept = [fact for fact in facts if fact not in taken]
+        with open(full, "w") as out:
+            out.write(program)
+        with open(fresh, "w") as out:
+            out.write(program[:section.start(1)] + "\n" + "\n".join(kept) + "\n" + program[section.end(1):])
+        with open(retracted, "w") as out:
+            out.write("\n".join(taken) + "\n")
+
+        checked += 1
+        if queries(run(full, "--retract", retracted)) != queries(run(fresh)):
+            failed += 1
+            print("%s: retracting %d facts answers differently" % (name, len(taken)))
+
+print("%d retractions checked, %d failed" % (checked, failed))
+sys.exit(1 if failed else 0)
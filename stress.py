@@ -0,0 +1,84 @@
+# Concurrency stress test for --socket: readers query while one writer inserts
+# facts, and every answer has to come from one consistent version.
+# Usage: python3 stress.py [./lab5]
+
+import os, re, socket, subprocess, sys, tempfile, threading, time
+
+binary = sys.argv[1] if len(sys.argv) > 1 else "./lab5"
+work = tempfile.mkdtemp()
+program = os.path.join(work, "chain.txt")
+path = os.path.join(work, "stress.sock")
+
+# A chain P('0','1'), P('1','2'), ... with A its transitive closure, so with m
+# P tuples A has m(m+1)/2. B is a large relation that every insert also adds
+# to, so publishing a version has to stay cheap as it grows. It's derived from
+# a few facts since scanning 50k of them would take most of the run
+with open(program, "w") as out:
+    out.write("Schemes:\n P(a,b)\n A(a,b)\n B(a,b)\n D(a)\nFacts:\n P('0','1').\n")
+    for i in range(224):
+        out.write(" D('%d').\n" % i)
+    out.write("Rules:\n A(x,y) :- P(x,y).\n A(x,z) :- A(x,y),P(y,z).\n B(x,y) :- D(x),D(y).\nQueries:\n A(x,y)?\n")
+
+server = subprocess.Popen([binary, program, "--socket", path], stdout=subprocess.DEVNULL)
+while not os.path.exists(path):
+    time.sleep(0.05)
+
+def connect():
+    client = socket.socket(socket.AF_UNIX)
+    client.connect(path)
+    return client
+
+def request(client, line):
+    client.sendall((line + "\n").encode())
+    reply = b""
+    while not re.search(rb"\(\d+\.\d+ ms\)\n$", reply):
+        reply += client.recv(1 << 20)
+    return reply.decode()
+
+inconsistent = [0]
+reads = [0]
+latencies = []
+writes = []
+stop = False
+
+def reader():
+    client = connect()
+    while not stop:
+        start = time.time()
+        reply = request(client, "P(x,y)? A(x,y)? B('0',y)?")
+        latencies.append(time.time() - start)
+        counts = [int(n) for n in re.findall(r"Yes\((\d+)\)", reply)]
+        m = counts[0]
+        if len(counts) != 3 or counts[1] != m * (m + 1) // 2:
+            inconsistent[0] += 1
+        reads[0] += 1
+    client.close()
+
+threads = [threading.Thread(target=reader) for _ in range(6)]
+for thread in threads:
+    thread.start()
+
+writer = connect()
+for k in range(1, 100):
+    start = time.time()
+    request(writer, "P('%d','%d'). B('x%d','y').\n" % (k, k + 1, k))
+    writes.append(time.time() - start)
+
+stop = True
+for thread in threads:
+    thread.join()
+
+final = request(writer, "P(x,y)? A(x,y)? B(x,y)?")
+server.kill()
+server.wait()
+
+latencies.sort()
+writes.sort()
+counts = [int(n) for n in re.findall(r"Yes\((\d+)\)", final)]
+print("reads %d, inconsistent %d, read p50 %.2f ms p99 %.2f ms, write p50 %.2f ms max %.2f ms"
+      % (reads[0], inconsistent[0], latencies[len(latencies) // 2] * 1000, latencies[int(len(latencies) * .99)] * 1000,
+         writes[len(writes) // 2] * 1000, writes[-1] * 1000))
+
+if inconsistent[0] > 0 or counts != [100, 5050, 224 * 224 + 99] or server.returncode not in (0, -9):
+    print("FAILED, final counts %s" % counts)
+    sys.exit(1)
@@ -0,0 +1,106 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <memory>
+#include "Relation.h"
+#include "LayeredRelation.h"
+#include "QueryCursor.h"
+#include "Predicate.h"
+#include "Parameter.h"
+
+using namespace std;
+
+//Cursors get copied partway through (count does it too), and a copy has to
+//walk on by itself without moving the original
+
+int failures = 0;
+
+void check(bool passed, const string& what)
+{
+    if (!passed)
+    {
+        cout << "FAIL " << what << endl;
+        failures++;
+    }
+}
+
+Relation makeRelation(const vector<string>& values)
+{
+    Relation relation("r", Scheme({"a", "b"}));
+    for (const string& value : values)
+    {
+        relation.addTuple(Tuple({value.substr(0, 1), value.substr(1)}));
+    }
+
+    return relation;
+}
+
+Predicate makeQuery()
+{
+    Predicate query("r");
+    Parameter x("X", true);
+    Parameter y("Y", true);
+    query.addParam(x);
+    query.addParam(y);
+    return query;
+}
+
+vector<string> rest(QueryCursor& cursor)
+{
+    vector<string> answers;
+    Tuple tuple(vector<string>{});
+    while (cursor.next(tuple))
+    {
+        answers.push_back(tuple[0] + tuple[1]);
+    }
+
+    return answers;
+}
+
+void checkCopies(const QueryCursor& start, const vector<string>& expected, const string& name)
+{
+    for (unsigned int taken = 0; taken <= expected.size(); taken++)
+    {
+        QueryCursor original = start;
+        Tuple tuple(vector<string>{});
+        for (unsigned int i = 0; i < taken; i++)
+        {
+            original.next(tuple);
+        }
+
+        vector<string> after(expected.begin() + taken, expected.end());
+        string where = name + " after " + to_string(taken);
+
+        QueryCursor copy = original;
+        check(original.count() == (int)expected.size(), where + ": count");
+        check(rest(copy) == after, where + ": copy");
+        check(rest(original) == after, where + ": original after the copy");
+
+        QueryCursor assigned = start;
+        assigned = copy;
+        assigned.rewind();
+        check(rest(assigned) == expected, where + ": assigned and rewound");
+    }
+}
+
+int main()
+{
+    Relation plain = makeRelation({"a1", "a2", "a3", "b1"});
+    checkCopies(QueryCursor(plain, makeQuery()), {"a1", "a2", "a3", "b1"}, "plain");
+
+    //Runs straight out of the base, then out of a layer, with tuples taken
+    //out in between
+    LayeredRelation base(make_shared<const Relation>(makeRelation({"a1", "a2", "a3", "a4", "c1", "c3"})));
+    Relation added = makeRelation({"b1", "b2", "b3", "c2"});
+    Relation removed = makeRelation({"a3", "c1"});
+    LayeredRelation layered = base.withChanges(&added, &removed);
+    checkCopies(QueryCursor(layered, makeQuery()), {"a1", "a2", "a4", "b1", "b2", "b3", "c2", "c3"}, "layered");
+
+    if (failures > 0)
+    {
+        return 1;
+    }
+
+    cout << "QueryCursor ok" << endl;
+    return 0;
+}